@@ -23,7 +23,7 @@ fatso_configuration_destroy(struct fatso_configuration* e) {
 }
 
 int
-fatso_configuration_parse(struct fatso_configuration* e, struct yaml_document_s* doc, struct yaml_node_s* node, char** out_error_message) {
+fatso_configuration_parse_dependencies(struct fatso_configuration* e, struct yaml_document_s* doc, struct yaml_node_s* node, char** out_error_message) {
   int r = 0;
 
   yaml_node_t* dependencies = fatso_yaml_mapping_lookup(doc, node, "dependencies");
@@ -40,6 +40,16 @@ fatso_configuration_parse(struct fatso_configuration* e, struct yaml_document_s*
     }
   }
 
+out:
+  return r;
+}
+
+int
+fatso_configuration_parse(struct fatso_configuration* e, struct yaml_document_s* doc, struct yaml_node_s* node, char** out_error_message) {
+  int r = fatso_configuration_parse_dependencies(e, doc, node, out_error_message);
+  if (r != 0)
+    goto out;
+
   yaml_node_t* defines = fatso_yaml_mapping_lookup(doc, node, "defines");
   if (defines && defines->type == YAML_MAPPING_NODE) {
     size_t len = fatso_yaml_mapping_length(defines);
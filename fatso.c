@@ -14,8 +14,16 @@
 
 int
 fatso_upgrade(struct fatso* f, int argc, char* const* argv) {
-  printf("<UPDATE> %s\n", f->global_dir);
-  return 0;
+  int r = fatso_load_project(f);
+  if (r != 0) goto out;
+
+  // Without package names, everything is upgraded.
+  r = fatso_upgrade_dependency_graph(f, (const char* const*)argv + 1, argc - 1);
+  if (r != 0) goto out;
+
+  r = fatso_install_dependencies(f);
+out:
+  return r;
 }
 
 static void
@@ -34,12 +42,18 @@ int
 fatso_init(struct fatso* f, const char* program_name) {
   f->program_name = program_name;
   f->project = NULL;
+  f->repository = NULL;
   f->command = NULL;
   f->global_dir = NULL;
   f->working_dir = NULL;
   f->logger = &g_default_logger;
   f->consolidated_configuration = fatso_alloc(sizeof(struct fatso_configuration));
   fatso_configuration_init(f->consolidated_configuration);
+  f->resolve_jobs = 0;
+  f->resolve_heuristic = NULL;
+  f->resolve_timeout = 0;
+  f->resolve_max_candidates = 0;
+  f->resolve_stats = FATSO_RESOLVE_STATS_NONE;
   return 0;
 }
 
@@ -51,6 +65,18 @@ fatso_set_logger(struct fatso* f, const struct fatso_logger* logger) {
 void fatso_set_home_directory(struct fatso* f, const char* path) {
   free(f->global_dir);
   f->global_dir = realpath(path, NULL);
+  if (f->repository && (f->global_dir == NULL || strcmp(fatso_repository_home_directory(f->repository), f->global_dir) != 0)) {
+    fatso_set_repository(f, NULL);
+  }
+}
+
+void
+fatso_set_repository(struct fatso* f, struct fatso_repository* repository) {
+  if (repository) {
+    fatso_repository_retain(repository);
+  }
+  fatso_repository_release(f->repository);
+  f->repository = repository;
 }
 
 const char*
@@ -117,6 +143,7 @@ fatso_project_directory(struct fatso* f) {
 void
 fatso_destroy(struct fatso* f) {
   fatso_free(f->project);
+  fatso_repository_release(f->repository);
   fatso_free(f->global_dir);
   fatso_free(f->working_dir);
 }
@@ -9,20 +9,37 @@ extern "C" {
 #endif
 
 struct fatso;
+struct fatso_repository;
 struct fatso_project;
 struct fatso_logger;
 struct fatso_configuration;
+struct fatso_decision_heuristic;
 
 typedef int(*fatso_command_t)(struct fatso*, int argc, char* const* argv);
 
+// The most threads --resolve-jobs accepts.
+#define FATSO_MAX_RESOLVE_JOBS 256
+
+enum fatso_resolve_stats_format {
+  FATSO_RESOLVE_STATS_NONE,
+  FATSO_RESOLVE_STATS_HUMAN,
+  FATSO_RESOLVE_STATS_JSON,
+};
+
 struct fatso {
   const char* program_name;
   fatso_command_t command;
   char* global_dir;
   char* working_dir;
   struct fatso_project* project;
+  struct fatso_repository* repository; // opened on first use, see fatso_set_repository
   const struct fatso_logger* logger;
   struct fatso_configuration* consolidated_configuration;
+  unsigned int resolve_jobs; // threads used to resolve dependencies, 0 or 1 for sequential
+  const struct fatso_decision_heuristic* resolve_heuristic; // NULL for the default
+  double resolve_timeout; // seconds the resolver may take, 0 for no limit
+  size_t resolve_max_candidates; // package versions the resolver may try, 0 for no limit
+  enum fatso_resolve_stats_format resolve_stats;
 };
 
 enum fatso_log_level {
@@ -48,12 +65,22 @@ int fatso_load_environment(struct fatso*);
 // Repository functions:
 int fatso_sync_packages(struct fatso*);
 
+// A packages repository, with the packages loaded from it so far. It may be
+// shared by several `struct fatso` resolving projects on different threads,
+// and lives until the last of them releases it.
+struct fatso_repository* fatso_repository_new(const char* home_directory);
+struct fatso_repository* fatso_repository_retain(struct fatso_repository*);
+void fatso_repository_release(struct fatso_repository*);
+const char* fatso_repository_home_directory(const struct fatso_repository*);
+void fatso_set_repository(struct fatso*, struct fatso_repository*);
+
 // Project functions:
 int fatso_load_project(struct fatso*);
 void fatso_unload_project(struct fatso*);
 int fatso_load_dependency_graph(struct fatso*);
 int fatso_generate_dependency_graph(struct fatso*);
 int fatso_load_or_generate_dependency_graph(struct fatso*);
+int fatso_upgrade_dependency_graph(struct fatso*, const char* const* names, size_t num_names);
 int fatso_install_dependencies(struct fatso*);
 
 
@@ -101,3 +101,15 @@ fatso_git_source_init(struct fatso_source* source, const char* url, const char*
   data->url = strdup(url);
   data->ref = strdup(ref);
 }
+
+const char*
+fatso_git_source_url(const struct fatso_source* source) {
+  const struct git_data* data = source->thunk;
+  return data->url;
+}
+
+const char*
+fatso_git_source_ref(const struct fatso_source* source) {
+  const struct git_data* data = source->thunk;
+  return data->ref;
+}
@@ -16,7 +16,7 @@ usage(const char* program_name) {
     "\n\tinit         Create an empty fatso.yml in the working dir, if none exists."
     "\n\tbuild        Builds the current Fatso project."
     "\n\tinstall      Installs dependencies for the current Fatso project."
-    "\n\tupgrade      Upgrades dependencies for the current Fatso project. Implies 'sync'."
+    "\n\tupgrade      Upgrades dependencies for the current Fatso project."
     "\n\tsync         Get latest package descriptions from online repository."
     "\n\tclean        Clean slate."
     "\n\tenv          Print the environment used by exec, build, etc."
@@ -35,10 +35,31 @@ static void
 build_usage(const char* program_name) {}
 
 static void
-install_usage(const char* program_name) {}
+install_usage(const char* program_name) {
+  fprintf(stderr, "Usage:\n\t%s install [options]\n\n", program_name);
+  fprintf(stderr,
+    "Options:"
+    "\n\t-j <n>, --resolve-jobs=<n>"
+    "\n\t                         Resolve dependencies with <n> threads (default: 1)"
+    "\n\t--resolve-stats[=json]   Print what the dependency resolver did, as text or JSON"
+    "\n\t--resolve-order=<order>  Decide dependencies in 'name' (default) or 'most-constrained' order"
+    "\n\t--resolve-timeout=<s>    Give up resolving dependencies after <s> seconds"
+    "\n\t--resolve-max-candidates=<n>"
+    "\n\t                         Give up resolving dependencies after trying <n> package versions"
+    "\n\n");
+}
 
 static void
-upgrade_usage(const char* program_name) {}
+upgrade_usage(const char* program_name) {
+  fprintf(stderr, "Usage:\n\t%s upgrade [options] [<package>...]\n\n", program_name);
+  fprintf(stderr,
+    "Upgrades the named packages, and the packages that depend on them, to the\n"
+    "newest versions that fit. Every other package keeps the version in\n"
+    "fatso.lock.yml. Without package names, everything is upgraded.\n\n"
+    "Only versions already in the packages repository are considered; run\n"
+    "`%s sync` first to fetch new ones.\n\n"
+    "Takes the same options as install.\n\n", program_name);
+}
 
 static void
 sync_usage(const char* program_name) {}
@@ -0,0 +1,553 @@
+#include "fatso.h"
+#include "internal.h"
+#include "util.h"
+
+#include <stdio.h> // asprintf, fdopen, rename
+#include <stdlib.h> // mkstemp
+#include <unistd.h> // close, unlink
+#include <string.h> // strcmp, strerror
+#include <errno.h>
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+
+/*
+  The index is the header below followed by its tables in the order of the
+  header, and then the strings. Records refer to each other by index, and to
+  strings by their offset in the string table, where 0 means NULL. It's
+  written and read by the same machine, so everything is in native byte order.
+  The header takes a multiple of 8 bytes, so the words right after it are aligned.
+*/
+
+#define INDEX_MAGIC "FATSOIX2"
+
+struct index_header {
+  char magic[8];
+  uint32_t revision; // string
+  uint32_t num_dead; // versions the presolve found can never be installed
+  uint32_t num_words;
+  uint32_t num_names;
+  uint32_t num_packages;
+  uint32_t num_configurations;
+  uint32_t num_dependencies;
+  uint32_t num_constraints;
+  uint32_t num_pairs;
+  uint32_t strings_size;
+};
+
+enum index_package_flags {
+  INDEX_PACKAGE_DEAD = 1,
+};
+
+struct index_name {
+  uint32_t name; // the names are sorted
+  uint32_t first_package;
+  uint32_t num_packages; // sorted by version
+};
+
+struct index_package {
+  uint32_t name;
+  uint32_t version;
+  uint32_t author;
+  uint32_t toolchain;
+  uint32_t source_type; // 0 if there's no source
+  uint32_t source_url;
+  uint32_t source_ref;
+  uint32_t first_configuration; // the base configuration comes first
+  uint32_t num_configurations;
+  uint32_t flags;
+};
+
+struct index_configuration {
+  uint32_t name;
+  uint32_t first_dependency;
+  uint32_t num_dependencies;
+  uint32_t first_define;
+  uint32_t num_defines;
+  uint32_t first_env;
+  uint32_t num_env;
+};
+
+struct index_dependency {
+  uint32_t name;
+  uint32_t first_constraint;
+  uint32_t num_constraints;
+  uint32_t first_compatible; // words, 0 of them unless the index was presolved
+  uint32_t num_compatible;
+};
+
+struct index_constraint {
+  uint32_t version_requirement;
+  uint32_t version;
+};
+
+struct index_pair {
+  uint32_t key;
+  uint32_t value;
+};
+
+struct index_tables {
+  const struct index_header* header;
+  const uint64_t* words;
+  const struct index_name* names;
+  const struct index_package* packages;
+  const struct index_configuration* configurations;
+  const struct index_dependency* dependencies;
+  const struct index_constraint* constraints;
+  const struct index_pair* pairs;
+  const char* strings;
+};
+
+struct index_builder {
+  FATSO_ARRAY(uint64_t) words;
+  FATSO_ARRAY(struct index_name) names;
+  FATSO_ARRAY(struct index_package) packages;
+  FATSO_ARRAY(struct index_configuration) configurations;
+  FATSO_ARRAY(struct index_dependency) dependencies;
+  FATSO_ARRAY(struct index_constraint) constraints;
+  FATSO_ARRAY(struct index_pair) pairs;
+  FATSO_ARRAY(char) strings;
+};
+
+static uint32_t
+add_string(struct index_builder* b, const char* string) {
+  if (string == NULL)
+    return 0;
+  uint32_t offset = b->strings.size;
+  fatso_append_v(&b->strings, string, strlen(string) + 1);
+  return offset;
+}
+
+static void
+add_pairs(struct index_builder* b, const fatso_dictionary_t* dict, uint32_t* out_first, uint32_t* out_num) {
+  *out_first = b->pairs.size;
+  *out_num = dict->size;
+  for (size_t i = 0; i < dict->size; ++i) {
+    struct index_pair pair = {
+      .key = add_string(b, dict->data[i].key),
+      .value = add_string(b, dict->data[i].value),
+    };
+    fatso_push_back_v(&b->pairs, &pair);
+  }
+}
+
+static void
+add_configuration(struct index_builder* b, const struct fatso_configuration* config) {
+  struct index_configuration c = {
+    .name = add_string(b, config->name),
+    .first_dependency = b->dependencies.size,
+    .num_dependencies = config->dependencies.size,
+  };
+  for (size_t i = 0; i < config->dependencies.size; ++i) {
+    const struct fatso_dependency* dep = &config->dependencies.data[i];
+    struct index_dependency d = {
+      .name = add_string(b, dep->name),
+      .first_constraint = b->constraints.size,
+      .num_constraints = dep->constraints.size,
+      .first_compatible = b->words.size,
+      .num_compatible = dep->compatible.size,
+    };
+    if (dep->compatible.size) {
+      fatso_append_v(&b->words, dep->compatible.data, dep->compatible.size);
+    }
+    for (size_t j = 0; j < dep->constraints.size; ++j) {
+      const struct fatso_constraint* constraint = &dep->constraints.data[j];
+      struct index_constraint ic = {
+        .version_requirement = constraint->version_requirement,
+        .version = add_string(b, fatso_version_string(&constraint->version)),
+      };
+      fatso_push_back_v(&b->constraints, &ic);
+    }
+    fatso_push_back_v(&b->dependencies, &d);
+  }
+  add_pairs(b, &config->defines, &c.first_define, &c.num_defines);
+  add_pairs(b, &config->env, &c.first_env, &c.num_env);
+  fatso_push_back_v(&b->configurations, &c);
+}
+
+static void
+add_package(struct index_builder* b, const struct fatso_package* package) {
+  struct index_package p = {
+    .name = add_string(b, package->name),
+    .version = add_string(b, fatso_version_string(&package->version)),
+    .author = add_string(b, package->author),
+    .toolchain = add_string(b, package->toolchain),
+    .first_configuration = b->configurations.size,
+    .num_configurations = 1 + package->configurations.size,
+    .flags = package->is_dead ? INDEX_PACKAGE_DEAD : 0,
+  };
+  if (package->source) {
+    p.source_type = add_string(b, package->source->vtbl->type);
+    if (strcmp(package->source->vtbl->type, "git") == 0) {
+      p.source_url = add_string(b, fatso_git_source_url(package->source));
+      p.source_ref = add_string(b, fatso_git_source_ref(package->source));
+    } else {
+      p.source_url = add_string(b, package->source->name);
+    }
+  }
+  add_configuration(b, &package->base_configuration);
+  for (size_t i = 0; i < package->configurations.size; ++i) {
+    add_configuration(b, &package->configurations.data[i]);
+  }
+  fatso_push_back_v(&b->packages, &p);
+}
+
+static int
+write_table(FILE* fp, const void* data, size_t element_size, size_t num_elements) {
+  if (num_elements == 0)
+    return 0;
+  return fwrite(data, element_size, num_elements, fp) == num_elements ? 0 : 1;
+}
+
+int
+fatso_package_index_write(struct fatso* f, const char* path, const char* revision, const char* const* names, size_t num_names, bool presolve) {
+  int r = 0;
+  char* tmp_path = NULL;
+  FILE* fp = NULL;
+  struct index_builder b = {{0}};
+  FATSO_ARRAY(struct fatso_package_versions) packages = {0};
+  size_t num_dead = 0;
+
+  for (size_t i = 0; i < num_names; ++i) {
+    struct fatso_package_versions versions = { .name = names[i] };
+    ssize_t num_versions = fatso_repository_parse_package_versions(f, names[i], false, &versions.data);
+    if (num_versions < 0)
+      continue;
+    versions.size = num_versions;
+    fatso_push_back_v(&packages, &versions);
+  }
+  if (presolve) {
+    num_dead = fatso_presolve(packages.data, packages.size);
+  }
+
+  // Offset 0 is NULL.
+  fatso_append_v(&b.strings, "", 1);
+  uint32_t revision_offset = add_string(&b, revision);
+
+  for (size_t i = 0; i < packages.size; ++i) {
+    struct index_name n = {
+      .name = add_string(&b, packages.data[i].name),
+      .first_package = b.packages.size,
+      .num_packages = packages.data[i].size,
+    };
+    fatso_push_back_v(&b.names, &n);
+    for (size_t j = 0; j < packages.data[i].size; ++j) {
+      add_package(&b, &packages.data[i].data[j]);
+    }
+  }
+
+  struct index_header header = {
+    .magic = INDEX_MAGIC,
+    .revision = revision_offset,
+    .num_dead = num_dead,
+    .num_words = b.words.size,
+    .num_names = b.names.size,
+    .num_packages = b.packages.size,
+    .num_configurations = b.configurations.size,
+    .num_dependencies = b.dependencies.size,
+    .num_constraints = b.constraints.size,
+    .num_pairs = b.pairs.size,
+    .strings_size = b.strings.size,
+  };
+
+  // Readers either see the old index or the new one, never half of it, even
+  // with other threads or Fatso processes writing it at the same time.
+  asprintf(&tmp_path, "%s.XXXXXX", path);
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    r = 1;
+    goto out;
+  }
+  fp = fdopen(fd, "wb");
+  if (fp == NULL) {
+    close(fd);
+    unlink(tmp_path);
+    r = 1;
+    goto out;
+  }
+  r = write_table(fp, &header, sizeof(header), 1)
+    || write_table(fp, b.words.data, sizeof(uint64_t), b.words.size)
+    || write_table(fp, b.names.data, sizeof(struct index_name), b.names.size)
+    || write_table(fp, b.packages.data, sizeof(struct index_package), b.packages.size)
+    || write_table(fp, b.configurations.data, sizeof(struct index_configuration), b.configurations.size)
+    || write_table(fp, b.dependencies.data, sizeof(struct index_dependency), b.dependencies.size)
+    || write_table(fp, b.constraints.data, sizeof(struct index_constraint), b.constraints.size)
+    || write_table(fp, b.pairs.data, sizeof(struct index_pair), b.pairs.size)
+    || write_table(fp, b.strings.data, 1, b.strings.size);
+  r = fclose(fp) || r;
+  if (r == 0 && rename(tmp_path, path) != 0) {
+    r = 1;
+  }
+  if (r != 0) {
+    int error = errno;
+    unlink(tmp_path);
+    errno = error;
+  }
+
+out:
+  for (size_t i = 0; i < packages.size; ++i) {
+    for (size_t j = 0; j < packages.data[i].size; ++j) {
+      fatso_package_destroy(&packages.data[i].data[j]);
+    }
+    fatso_free(packages.data[i].data);
+  }
+  fatso_free(packages.data);
+  fatso_free(b.words.data);
+  fatso_free(b.names.data);
+  fatso_free(b.packages.data);
+  fatso_free(b.configurations.data);
+  fatso_free(b.dependencies.data);
+  fatso_free(b.constraints.data);
+  fatso_free(b.pairs.data);
+  fatso_free(b.strings.data);
+  fatso_free(tmp_path);
+  return r;
+}
+
+static bool
+string_is_valid(const struct index_tables* t, uint32_t offset) {
+  return offset < t->header->strings_size;
+}
+
+static bool
+range_is_valid(uint32_t first, uint32_t num, uint32_t size) {
+  return first <= size && num <= size - first;
+}
+
+// Checks every reference once, so lookups can trust the index.
+static bool
+index_is_valid(const struct index_tables* t) {
+  const struct index_header* h = t->header;
+  if (h->strings_size == 0 || t->strings[h->strings_size - 1] != '\0' || !string_is_valid(t, h->revision))
+    return false;
+  for (uint32_t i = 0; i < h->num_names; ++i) {
+    const struct index_name* n = &t->names[i];
+    if (!string_is_valid(t, n->name) || n->name == 0 || !range_is_valid(n->first_package, n->num_packages, h->num_packages))
+      return false;
+  }
+  for (uint32_t i = 0; i < h->num_packages; ++i) {
+    const struct index_package* p = &t->packages[i];
+    if (!string_is_valid(t, p->name) || !string_is_valid(t, p->version) || !string_is_valid(t, p->author)
+      || !string_is_valid(t, p->toolchain) || !string_is_valid(t, p->source_type) || !string_is_valid(t, p->source_url)
+      || !string_is_valid(t, p->source_ref) || p->num_configurations == 0
+      || !range_is_valid(p->first_configuration, p->num_configurations, h->num_configurations))
+      return false;
+  }
+  for (uint32_t i = 0; i < h->num_configurations; ++i) {
+    const struct index_configuration* c = &t->configurations[i];
+    if (!string_is_valid(t, c->name) || !range_is_valid(c->first_dependency, c->num_dependencies, h->num_dependencies)
+      || !range_is_valid(c->first_define, c->num_defines, h->num_pairs) || !range_is_valid(c->first_env, c->num_env, h->num_pairs))
+      return false;
+  }
+  for (uint32_t i = 0; i < h->num_dependencies; ++i) {
+    const struct index_dependency* d = &t->dependencies[i];
+    if (!string_is_valid(t, d->name) || d->name == 0 || !range_is_valid(d->first_constraint, d->num_constraints, h->num_constraints)
+      || !range_is_valid(d->first_compatible, d->num_compatible, h->num_words))
+      return false;
+  }
+  for (uint32_t i = 0; i < h->num_constraints; ++i) {
+    if (!string_is_valid(t, t->constraints[i].version) || t->constraints[i].version_requirement > FATSO_VERSION_APPROXIMATELY)
+      return false;
+  }
+  for (uint32_t i = 0; i < h->num_pairs; ++i) {
+    if (!string_is_valid(t, t->pairs[i].key) || !string_is_valid(t, t->pairs[i].value))
+      return false;
+  }
+  return true;
+}
+
+// Finds the tables in an index of `size` bytes. Returns false if they don't fit.
+static bool
+index_tables(const void* data, size_t size, struct index_tables* t) {
+  const struct index_header* h = data;
+  if (size < sizeof(*h) || memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0)
+    return false;
+  const char* p = (const char*)(h + 1);
+  const char* end = (const char*)data + size;
+#define INDEX_TABLE(FIELD, COUNT) \
+  t->FIELD = (const void*)p; \
+  if ((size_t)(end - p) / sizeof(*t->FIELD) < (COUNT)) \
+    return false; \
+  p += (COUNT) * sizeof(*t->FIELD);
+  t->header = h;
+  INDEX_TABLE(words, h->num_words);
+  INDEX_TABLE(names, h->num_names);
+  INDEX_TABLE(packages, h->num_packages);
+  INDEX_TABLE(configurations, h->num_configurations);
+  INDEX_TABLE(dependencies, h->num_dependencies);
+  INDEX_TABLE(constraints, h->num_constraints);
+  INDEX_TABLE(pairs, h->num_pairs);
+  INDEX_TABLE(strings, h->strings_size);
+#undef INDEX_TABLE
+  return p == end;
+}
+
+int
+fatso_package_index_open(struct fatso_package_index* index, const char* path, const char* revision) {
+  memset(index, 0, sizeof(*index));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 1;
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED)
+    return 1;
+
+  struct index_tables t;
+  if (!index_tables(data, st.st_size, &t) || !index_is_valid(&t) || strcmp(t.strings + t.header->revision, revision) != 0) {
+    munmap(data, st.st_size);
+    return 1;
+  }
+  index->data = data;
+  index->size = st.st_size;
+  return 0;
+}
+
+void
+fatso_package_index_close(struct fatso_package_index* index) {
+  if (index->data) {
+    munmap(index->data, index->size);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+static char*
+index_strdup(const struct index_tables* t, uint32_t offset) {
+  return offset ? strdup(t->strings + offset) : NULL;
+}
+
+static void
+load_pairs(const struct index_tables* t, fatso_dictionary_t* dict, uint32_t first, uint32_t num) {
+  if (num == 0)
+    return;
+  dict->size = num;
+  dict->data = fatso_calloc(num, sizeof(struct fatso_kv_pair));
+  for (uint32_t i = 0; i < num; ++i) {
+    const struct index_pair* pair = &t->pairs[first + i];
+    dict->data[i].key = index_strdup(t, pair->key);
+    dict->data[i].value = index_strdup(t, pair->value);
+  }
+}
+
+static void
+load_configuration(const struct index_tables* t, struct fatso_configuration* config, const struct index_configuration* c, bool summary) {
+  fatso_configuration_init(config);
+  config->name = index_strdup(t, c->name);
+  if (c->num_dependencies != 0) {
+    config->dependencies.size = c->num_dependencies;
+    config->dependencies.data = fatso_calloc(c->num_dependencies, sizeof(struct fatso_dependency));
+  }
+  for (uint32_t i = 0; i < c->num_dependencies; ++i) {
+    const struct index_dependency* d = &t->dependencies[c->first_dependency + i];
+    struct fatso_constraint* constraints = fatso_calloc(d->num_constraints + 1, sizeof(struct fatso_constraint));
+    for (uint32_t j = 0; j < d->num_constraints; ++j) {
+      const struct index_constraint* ic = &t->constraints[d->first_constraint + j];
+      constraints[j].version_requirement = ic->version_requirement;
+      fatso_version_from_string(&constraints[j].version, t->strings + ic->version);
+    }
+    fatso_dependency_init(&config->dependencies.data[i], t->strings + d->name, constraints, d->num_constraints);
+    if (d->num_compatible) {
+      fatso_append_v(&config->dependencies.data[i].compatible, t->words + d->first_compatible, d->num_compatible);
+    }
+    for (uint32_t j = 0; j < d->num_constraints; ++j) {
+      fatso_constraint_destroy(&constraints[j]);
+    }
+    fatso_free(constraints);
+  }
+  if (!summary) {
+    load_pairs(t, &config->defines, c->first_define, c->num_defines);
+    load_pairs(t, &config->env, c->first_env, c->num_env);
+  }
+}
+
+// A summary only has what the resolver needs: the name, version and dependencies.
+static void
+load_package(const struct index_tables* t, struct fatso_package* package, const struct index_package* p, bool summary) {
+  fatso_package_init(package);
+  package->name = index_strdup(t, p->name);
+  if (package->name) {
+    package->name_id = fatso_intern(package->name);
+  }
+  if (p->version) {
+    fatso_version_from_string(&package->version, t->strings + p->version);
+  }
+  package->is_summary = summary;
+  package->is_dead = (p->flags & INDEX_PACKAGE_DEAD) != 0;
+  if (!summary) {
+    package->author = index_strdup(t, p->author);
+    package->toolchain = index_strdup(t, p->toolchain);
+  }
+  if (p->source_type && !summary) {
+    package->source = fatso_alloc(sizeof(struct fatso_source));
+    if (strcmp(t->strings + p->source_type, "git") == 0) {
+      fatso_git_source_init(package->source, t->strings + p->source_url, t->strings + p->source_ref);
+    } else {
+      fatso_tarball_source_init(package->source, t->strings + p->source_url);
+    }
+  }
+  load_configuration(t, &package->base_configuration, &t->configurations[p->first_configuration], summary);
+  size_t num_configurations = p->num_configurations - 1;
+  if (num_configurations != 0) {
+    package->configurations.size = num_configurations;
+    package->configurations.data = fatso_calloc(num_configurations, sizeof(struct fatso_configuration));
+  }
+  for (size_t i = 0; i < num_configurations; ++i) {
+    load_configuration(t, &package->configurations.data[i], &t->configurations[p->first_configuration + 1 + i], summary);
+  }
+}
+
+static const struct index_name*
+find_name(const struct index_tables* t, const char* name) {
+  size_t begin = 0;
+  size_t end = t->header->num_names;
+  while (begin < end) {
+    size_t mid = begin + (end - begin) / 2;
+    int cmp = strcmp(t->strings + t->names[mid].name, name);
+    if (cmp == 0) {
+      return &t->names[mid];
+    } else if (cmp < 0) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return NULL;
+}
+
+ssize_t
+fatso_package_index_load_versions(const struct fatso_package_index* index, const char* name, bool summaries, struct fatso_package** out_packages) {
+  struct index_tables t;
+  index_tables(index->data, index->size, &t);
+  const struct index_name* n = find_name(&t, name);
+  if (n == NULL)
+    return -1;
+
+  struct fatso_package* packages = fatso_calloc(n->num_packages + 1, sizeof(struct fatso_package));
+  for (uint32_t i = 0; i < n->num_packages; ++i) {
+    load_package(&t, &packages[i], &t.packages[n->first_package + i], summaries);
+  }
+  *out_packages = packages;
+  return n->num_packages;
+}
+
+int
+fatso_package_index_load_package(const struct fatso_package_index* index, const char* name, const char* version, struct fatso_package* out_package) {
+  struct index_tables t;
+  index_tables(index->data, index->size, &t);
+  const struct index_name* n = find_name(&t, name);
+  if (n == NULL)
+    return 1;
+
+  for (uint32_t i = 0; i < n->num_packages; ++i) {
+    const struct index_package* p = &t.packages[n->first_package + i];
+    if (p->version && strcmp(t.strings + p->version, version) == 0) {
+      load_package(&t, out_package, p, false);
+      return 0;
+    }
+  }
+  return 1;
+}
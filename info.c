@@ -68,8 +68,10 @@ fatso_info(struct fatso* f, int argc, char* const* argv) {
     res = fatso_repository_find_package(f, argv[1], NULL, &package);
     switch (res) {
       case FATSO_PACKAGE_OK: {
-        display_info_for_package(package);
-        r = 0;
+        r = fatso_repository_load_package(f, package);
+        if (r == 0) {
+          display_info_for_package(package);
+        }
         break;
       }
       case FATSO_PACKAGE_UNKNOWN: {
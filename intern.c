@@ -0,0 +1,125 @@
+#include "internal.h"
+
+#include <string.h> // strcmp, strdup
+#include <stdint.h> // uint32_t
+#include <pthread.h>
+
+/*
+  Package names are interned once per process, so the resolver can compare
+  them as integers and use them to index arrays instead of searching sorted
+  lists of strings. IDs are dense and start at 1, so 0 can mean "no name".
+  Interned names are never freed.
+
+  Interning takes a lock, but looking up a name doesn't: names are stored in
+  blocks that double in size and never move once allocated.
+*/
+
+#define FIRST_BLOCK_SIZE 64
+#define MAX_BLOCKS 32
+
+static struct {
+  pthread_mutex_t lock;
+  char** blocks[MAX_BLOCKS];
+  size_t size;              // number of names, read without the lock
+  unsigned int* buckets;    // open addressing, 0 is an empty bucket
+  size_t num_buckets;       // always a power of two
+} g_names = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static size_t
+locate_name(size_t idx, size_t* out_offset) {
+  // Block b holds FIRST_BLOCK_SIZE << b names, starting at FIRST_BLOCK_SIZE * (2^b - 1).
+  size_t n = idx / FIRST_BLOCK_SIZE + 1;
+  size_t b = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(n);
+  *out_offset = idx - FIRST_BLOCK_SIZE * ((1ul << b) - 1);
+  return b;
+}
+
+static char**
+name_slot(size_t idx) {
+  size_t offset;
+  size_t b = locate_name(idx, &offset);
+  if (g_names.blocks[b] == NULL) {
+    g_names.blocks[b] = fatso_calloc(FIRST_BLOCK_SIZE << b, sizeof(char*));
+  }
+  return &g_names.blocks[b][offset];
+}
+
+static uint32_t
+hash_name(const char* name) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (const char* p = name; *p; ++p) {
+    h ^= (unsigned char)*p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void
+grow_buckets() {
+  size_t num_buckets = g_names.num_buckets ? g_names.num_buckets * 2 : 64;
+  unsigned int* buckets = fatso_calloc(num_buckets, sizeof(unsigned int));
+  for (size_t i = 0; i < g_names.size; ++i) {
+    size_t b = hash_name(*name_slot(i)) & (num_buckets - 1);
+    while (buckets[b] != 0) {
+      b = (b + 1) & (num_buckets - 1);
+    }
+    buckets[b] = i + 1;
+  }
+  fatso_free(g_names.buckets);
+  g_names.buckets = buckets;
+  g_names.num_buckets = num_buckets;
+}
+
+unsigned int
+fatso_intern(const char* name) {
+  if (name == NULL)
+    return 0;
+
+  pthread_mutex_lock(&g_names.lock);
+  if ((g_names.size + 1) * 2 > g_names.num_buckets) {
+    grow_buckets();
+  }
+
+  unsigned int id;
+  size_t mask = g_names.num_buckets - 1;
+  for (size_t b = hash_name(name) & mask;; b = (b + 1) & mask) {
+    id = g_names.buckets[b];
+    if (id == 0) {
+      *name_slot(g_names.size) = strdup(name);
+      id = g_names.size + 1;
+      g_names.buckets[b] = id;
+      __atomic_store_n(&g_names.size, g_names.size + 1, __ATOMIC_RELEASE);
+      break;
+    }
+    if (strcmp(*name_slot(id - 1), name) == 0) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_names.lock);
+  return id;
+}
+
+const char*
+fatso_interned_name(unsigned int id) {
+  if (id == 0 || id > __atomic_load_n(&g_names.size, __ATOMIC_ACQUIRE))
+    return NULL;
+  size_t offset;
+  size_t b = locate_name(id - 1, &offset);
+  return g_names.blocks[b][offset];
+}
+
+unsigned int
+fatso_interned_name_limit() {
+  // One past the largest ID, for sizing arrays indexed by name ID.
+  return __atomic_load_n(&g_names.size, __ATOMIC_ACQUIRE) + 1;
+}
+
+int
+fatso_compare_name_ids_by_name(const void* pa, const void* pb) {
+  unsigned int a = *(const unsigned int*)pa;
+  unsigned int b = *(const unsigned int*)pb;
+  return a == b ? 0 : strcmp(fatso_interned_name(a), fatso_interned_name(b));
+}
@@ -29,6 +29,36 @@ void fatso_logf(struct fatso*, int level, const char* fmt, ...);
 #define YELLOW  "\033[01;33m"
 #define RESET   "\033[00m"
 
+// Resolver statistics, for `--resolve-stats`:
+struct fatso_resolve_stats {
+  size_t candidates;             // package versions pinned by the resolver
+  size_t dead_ends;              // candidates skipped because of a learned nogood
+  size_t backtracks;             // candidates given up on in favour of an older version
+  size_t backjumps;              // decisions skipped because they weren't to blame
+  size_t nogoods;                // sets of decisions learned to be unsatisfiable
+  size_t unsatisfiable;          // dependencies ruled out as soon as they were added
+  size_t graph_copies;
+  size_t constraint_evaluations; // versions matched against a set of constraints
+  size_t repository_hits;        // lookups of packages that were already loaded
+  size_t repository_misses;      // lookups that had to read the packages directory
+  size_t prefetched;             // packages loaded before resolving
+  size_t presolved_matches;      // dependencies matched with the presolve's bitmaps instead of their constraints
+  size_t bytes_requested;        // cumulative: every fatso_calloc, and the full new size of every fatso_reallocf
+  double resolve_ms;
+  const char* source;            // where the install order came from
+};
+
+extern bool g_fatso_collect_stats;
+extern struct fatso_resolve_stats g_fatso_stats;
+
+#define FATSO_STAT_ADD(FIELD, N) do { \
+  if (g_fatso_collect_stats) \
+    __atomic_add_fetch(&g_fatso_stats.FIELD, (N), __ATOMIC_RELAXED); \
+} while (0)
+
+void fatso_resolve_stats_reset(bool enable);
+void fatso_resolve_stats_print(FILE* fp, bool json);
+
 struct yaml_node_s;
 struct yaml_document_s;
 struct yaml_parser_s;
@@ -39,16 +69,37 @@ char* fatso_yaml_scalar_strdup(struct yaml_node_s*);
 size_t fatso_yaml_sequence_length(struct yaml_node_s*);
 size_t fatso_yaml_mapping_length(struct yaml_node_s*);
 
+// Package names:
+unsigned int fatso_intern(const char* name);
+const char* fatso_interned_name(unsigned int id);
+unsigned int fatso_interned_name_limit();
+typedef FATSO_ARRAY(unsigned int) fatso_name_ids_t;
+// Orders name IDs by name, so the order doesn't depend on the order names happened to be interned in.
+int fatso_compare_name_ids_by_name(const void*, const void*);
+
+#define FATSO_VERSION_MAX_COMPONENTS 8
+
+struct fatso_version_component {
+  uint64_t key; // components order like their keys, see version.c
+  uint32_t offset; // where the component starts in `string`
+  uint32_t length;
+};
+
+// Components past FATSO_VERSION_MAX_COMPONENTS aren't kept; they're parsed
+// from `string` again when comparing versions whose kept components are equal.
 struct fatso_version {
   char* string;
-  FATSO_ARRAY(char*) components;
+  struct {
+    struct fatso_version_component data[FATSO_VERSION_MAX_COMPONENTS];
+    size_t size;
+    bool truncated; // there are more components than fit in `data`
+  } components;
 };
 
 void fatso_version_init(struct fatso_version*);
 void fatso_version_copy(struct fatso_version* dst, const struct fatso_version* src);
 void fatso_version_move(struct fatso_version* dst, struct fatso_version* src);
 void fatso_version_destroy(struct fatso_version*);
-void fatso_version_append_component(struct fatso_version*, const char* component, size_t n);
 int fatso_version_from_string(struct fatso_version*, const char*);
 int fatso_version_compare(const struct fatso_version* a, const struct fatso_version* b);
 int fatso_version_compare_t(void* thunk, const void* a, const void* b);
@@ -78,15 +129,70 @@ const char* fatso_constraint_to_string_unsafe(const struct fatso_constraint*);
 void fatso_constraint_destroy(struct fatso_constraint*);
 bool fatso_version_matches_constraints(const struct fatso_version*, const struct fatso_constraint* constraints, size_t num_constraints);
 
+enum fatso_version_bound_type {
+  FATSO_BOUND_NONE,
+  FATSO_BOUND_INCLUSIVE,
+  FATSO_BOUND_EXCLUSIVE,
+  FATSO_BOUND_PREFIX, // past every version that starts with `version`
+};
+
+struct fatso_version_bound {
+  struct fatso_version version;
+  enum fatso_version_bound_type type;
+};
+
+// The intersection of a set of constraints. Zero-initialized, it matches
+// every version.
+struct fatso_version_range {
+  struct fatso_version_bound lower;
+  struct fatso_version_bound upper;
+  bool empty;
+};
+
+void fatso_version_range_init(struct fatso_version_range*);
+void fatso_version_range_copy(struct fatso_version_range* dst, const struct fatso_version_range* src);
+void fatso_version_range_destroy(struct fatso_version_range*);
+// Returns false if no version can satisfy the range anymore.
+bool fatso_version_range_intersect(struct fatso_version_range*, const struct fatso_constraint*);
+bool fatso_version_range_contains(const struct fatso_version_range*, const struct fatso_version*);
+// -1 if `version` is below the range, 1 if it's above, and 0 if it's in it.
+// Every version is below an empty range.
+int fatso_version_range_compare(const struct fatso_version_range*, const struct fatso_version*);
+
+typedef FATSO_ARRAY(uint64_t) fatso_version_mask_t; // bit i % 64 of word i / 64 is version i
+
+/*
+  A sorted list of versions stored as columns, so a range can be matched
+  against all of them at once with loops over plain integers: keys[c * size + i]
+  is the key of component c of version i, or 0 past its end.
+*/
+struct fatso_version_columns {
+  size_t size;
+  size_t num_components; // the most any version has
+  uint64_t* keys;
+  uint8_t* sizes; // components in each version
+  bool keys_suffice; // false if some component needs its text to compare
+};
+
+void fatso_version_columns_init(struct fatso_version_columns*, const struct fatso_version* const* versions, size_t num_versions);
+void fatso_version_columns_destroy(struct fatso_version_columns*);
+// Sets the bits of the versions in `range`, in (size + 63) / 64 words. Returns
+// false, without touching the words, if the keys alone can't tell.
+bool fatso_version_range_match_columns(const struct fatso_version_range*, const struct fatso_version_columns*, uint64_t* out_words);
+
 struct fatso_dependency {
-  char* name;
-  FATSO_ARRAY(struct fatso_constraint) constraints;
+  const char* name; // interned
+  unsigned int name_id;
+  FATSO_ARRAY(struct fatso_constraint) constraints; // distinct, as written
+  struct fatso_version_range range; // what the constraints allow
+  fatso_version_mask_t compatible; // the versions in `range` that aren't dead, from the presolve, see presolve.c; empty if unknown
 };
 
 void fatso_dependency_init(struct fatso_dependency*, const char* name, const struct fatso_constraint* constraints, size_t num_constraints);
 void fatso_dependency_destroy(struct fatso_dependency*);
 int fatso_dependency_parse(struct fatso_dependency*, struct yaml_document_s*, struct yaml_node_s*, char** out_error_message);
-void fatso_dependency_add_constraint(struct fatso_dependency*, const struct fatso_constraint* constraint);
+// Returns false if the dependency can no longer be satisfied by any version.
+bool fatso_dependency_add_constraint(struct fatso_dependency*, const struct fatso_constraint* constraint);
 
 void fatso_kv_pair_init(struct fatso_kv_pair*, const char* key, const char* value);
 void fatso_kv_pair_destroy(struct fatso_kv_pair*);
@@ -101,6 +207,7 @@ struct fatso_configuration {
 void fatso_configuration_init(struct fatso_configuration*);
 void fatso_configuration_destroy(struct fatso_configuration*);
 int fatso_configuration_parse(struct fatso_configuration* env, struct yaml_document_s*, struct yaml_node_s*, char** out_error_message);
+int fatso_configuration_parse_dependencies(struct fatso_configuration* env, struct yaml_document_s*, struct yaml_node_s*, char** out_error_message);
 void fatso_configuration_add_package(struct fatso* f, struct fatso_configuration* config, struct fatso_package* package);
 void fatso_env_add_configuration(struct fatso* f, const struct fatso_configuration* config);
 void fatso_env_add_package(struct fatso* f, struct fatso_package* p);
@@ -127,18 +234,24 @@ int fatso_source_unpack(struct fatso*, struct fatso_package*, struct fatso_sourc
 
 void fatso_tarball_source_init(struct fatso_source*, const char* url);
 void fatso_git_source_init(struct fatso_source*, const char* url, const char* ref);
+const char* fatso_git_source_url(const struct fatso_source*);
+const char* fatso_git_source_ref(const struct fatso_source*);
 
 struct fatso_package_vtbl;
 
 struct fatso_package {
   const struct fatso_package_vtbl* vtbl;
   char* name;
+  unsigned int name_id; // 0 if the name hasn't been interned yet
   struct fatso_version version;
   char* author;
   char* toolchain;
   struct fatso_source* source; // TODO: Multiple sources
   struct fatso_configuration base_configuration;
   FATSO_ARRAY(struct fatso_configuration) configurations;
+  bool is_summary; // only the name, version and dependencies are loaded, see fatso_repository_load_package
+  char* path; // the file the package was read from, if any
+  bool is_dead; // the presolve found that it can never be installed
 };
 
 struct fatso_package_vtbl {
@@ -150,6 +263,7 @@ void fatso_package_init(struct fatso_package*);
 void fatso_package_destroy(struct fatso_package*);
 int fatso_package_parse(struct fatso_package*, struct yaml_document_s*, struct yaml_node_s*, char** out_error_message);
 int fatso_package_parse_from_file(struct fatso_package*, FILE* fp, char** out_error_message);
+int fatso_package_parse_summary_from_file(struct fatso_package*, FILE* fp, char** out_error_message);
 int fatso_package_parse_from_string(struct fatso_package*, const char* buffer, char** out_error_message);
 char* fatso_package_build_path(struct fatso*, struct fatso_package*);
 char* fatso_package_install_prefix(struct fatso*, struct fatso_package*);
@@ -193,16 +307,141 @@ enum fatso_repository_result {
   FATSO_PACKAGE_NO_MATCHING_VERSION,
 };
 
+ssize_t
+fatso_repository_find_package_versions(struct fatso* f, const char* name, struct fatso_package** out_packages);
+
 enum fatso_repository_result
 fatso_repository_find_package_matching_dependency(struct fatso* f, struct fatso_dependency* dep, struct fatso_version* less_than_version, struct fatso_package** out_package);
 
+// Returns the number of versions that satisfy `dep`, or -1 if the package is unknown.
+ssize_t
+fatso_repository_count_matching_versions(struct fatso* f, struct fatso_dependency* dep);
+
+/*
+  A cursor over the versions of a package that satisfy a dependency, newest
+  first. They're matched all at once when the cursor begins, so each step is
+  only a search for the next bit in the mask.
+*/
+struct fatso_repository_cursor {
+  struct fatso_package* versions;
+  ssize_t num_versions; // -1 if the package is unknown
+  fatso_version_mask_t mask;
+  size_t end; // the versions left are all below this index
+};
+
+// Returns the number of versions of the package, or -1 if it's unknown.
+ssize_t
+fatso_repository_cursor_begin(struct fatso* f, const struct fatso_dependency* dep, struct fatso_repository_cursor* cursor);
+
+// Returns the next older matching version, or NULL when there are no more.
+struct fatso_package*
+fatso_repository_cursor_next(struct fatso_repository_cursor* cursor);
+
+// Takes `package` out of the versions left. Returns false if it wasn't one of them.
+bool
+fatso_repository_cursor_remove(struct fatso_repository_cursor* cursor, const struct fatso_package* package);
+
+void
+fatso_repository_cursor_destroy(struct fatso_repository_cursor* cursor);
+
+// Matches `dep` against every version of its package at once. Sets the bits of
+// the versions that satisfy it in `inout_mask`, which is grown as needed, and
+// returns the number of versions, or -1 if the package is unknown.
+ssize_t
+fatso_repository_match_versions(struct fatso* f, const struct fatso_dependency* dep, struct fatso_package** out_packages, fatso_version_mask_t* inout_mask);
+
 enum fatso_repository_result
 fatso_repository_find_package(struct fatso* f, const char* name, struct fatso_version* less_than_version, struct fatso_package** out_package);
 
+// Loads every package `package` depends on, and everything those depend on in
+// turn, several packages at a time. The packages that aren't in the repository
+// are added to `out_unknown`, sorted by name, if it isn't NULL.
+void
+fatso_repository_prefetch(struct fatso* f, const struct fatso_package* package, fatso_name_ids_t* out_unknown);
+
+// The repository only loads summaries of packages at first, with what the
+// resolver needs. This loads the rest of `package`, in place.
+int
+fatso_repository_load_package(struct fatso* f, struct fatso_package* package);
+
+// The repository `f` looks packages up in, opened at its home directory the first time.
+struct fatso_repository*
+fatso_get_repository(struct fatso* f);
+
+// The commit the packages repository is checked out at, and a hash of its
+// version files' stat info, so uncommitted edits change it too. It's read
+// when the repository is opened. Fails if it isn't a git checkout.
+int
+fatso_repository_revision(struct fatso* f, char** out_revision);
+
+// Parses every version of `name` from the packages repository, sorted, or
+// summaries of them. Returns the number of versions, or -1 if there's no such package.
+ssize_t
+fatso_repository_parse_package_versions(struct fatso* f, const char* name, bool summaries, struct fatso_package** out_packages);
+
+// Compiles the packages repository into an index for its current revision.
+int
+fatso_repository_build_index(struct fatso* f);
+
+// Without an index, each package is cached in an index of its own under
+// ~/.fatso/cache/packages, which is valid for as long as this key is the same.
+// It changes when any of the package's version files do. Fails if there are none.
+int
+fatso_repository_package_cache_key(struct fatso* f, const char* name, char** out_key);
+
+char*
+fatso_repository_package_cache_path(struct fatso* f, const char* name);
+
+/*
+  The packages repository compiled into one file by `fatso sync`, so that
+  later commands can map it and look packages up without parsing any YAML.
+*/
+struct fatso_package_index {
+  void* data;
+  size_t size;
+};
+
+// Writes every version of the packages `names`, which are sorted. If they're
+// the whole repository, `presolve` also records what fatso_presolve finds.
+int
+fatso_package_index_write(struct fatso* f, const char* path, const char* revision, const char* const* names, size_t num_names, bool presolve);
+
+// Fails if there is no valid index at `path`, or if it's for another revision.
+int
+fatso_package_index_open(struct fatso_package_index* index, const char* path, const char* revision);
+
+void
+fatso_package_index_close(struct fatso_package_index* index);
+
+// Like fatso_repository_parse_package_versions, but from the index.
+ssize_t
+fatso_package_index_load_versions(const struct fatso_package_index* index, const char* name, bool summaries, struct fatso_package** out_packages);
+
+// Loads one version of `name`. Fails if the index doesn't have it.
+int
+fatso_package_index_load_package(const struct fatso_package_index* index, const char* name, const char* version, struct fatso_package* out_package);
+
+// Every version of a package, sorted, as fatso_presolve takes them.
+struct fatso_package_versions {
+  const char* name;
+  struct fatso_package* data;
+  size_t size;
+};
+
+// Marks the versions of `packages` that can never be installed as dead, and
+// fills in which versions each of their dependencies is compatible with.
+// `packages` must be the whole repository. Returns the number of dead versions.
+size_t
+fatso_presolve(struct fatso_package_versions* packages, size_t num_packages);
+
+typedef FATSO_ARRAY(size_t) fatso_install_levels_t; // where each level begins in an install order
+
 struct fatso_project {
   struct fatso_package package; // must be first :)
   char* path;
   FATSO_ARRAY(struct fatso_package*) install_order;
+  fatso_install_levels_t install_levels; // packages in a level don't depend on each other
+  FATSO_ARRAY(struct fatso_package*) preferred_versions; // tried first when resolving, sorted by name ID
 };
 
 void fatso_project_init(struct fatso_project*);
@@ -212,6 +451,7 @@ enum fatso_dependency_graph_resolution_status {
   FATSO_DEPENDENCY_GRAPH_SUCCESS,
   FATSO_DEPENDENCY_GRAPH_CONFLICT,
   FATSO_DEPENDENCY_GRAPH_UNKNOWN,
+  FATSO_DEPENDENCY_GRAPH_BUDGET_EXCEEDED, // see fatso.resolve_timeout and fatso.resolve_max_candidates
 };
 
 struct fatso_dependency_package_pair {
@@ -228,7 +468,24 @@ struct fatso_dependency_graph* fatso_dependency_graph_copy(struct fatso_dependen
 void fatso_dependency_graph_free(struct fatso_dependency_graph*);
 int fatso_dependency_graph_add_closed_set(struct fatso_dependency_graph*, struct fatso_package*);
 int fatso_dependency_graph_add_open_set(struct fatso_dependency_graph*, struct fatso_dependency*, struct fatso_package* dependency_of);
-void fatso_dependency_graph_topological_sort(struct fatso_dependency_graph*, struct fatso*, struct fatso_package***, size_t*);
+int fatso_dependency_graph_topological_sort(struct fatso_dependency_graph*, struct fatso*, struct fatso_package*** out_list, size_t* out_size, fatso_install_levels_t* out_levels);
+int fatso_sort_install_levels(struct fatso*, struct fatso_package** packages, size_t num_packages, fatso_install_levels_t* out_levels);
+
+/*
+  Decides which open dependency the resolver pins next. `choose` returns an
+  index into the graph's open set, which is sorted by name.
+*/
+struct fatso_decision_heuristic {
+  const char* name;
+  size_t(*choose)(const struct fatso_dependency_graph*);
+};
+
+// Fewest matching versions first:
+extern const struct fatso_decision_heuristic fatso_heuristic_most_constrained;
+// Reverse alphabetical order (the default):
+extern const struct fatso_decision_heuristic fatso_heuristic_by_name;
+
+const struct fatso_decision_heuristic* fatso_decision_heuristic_by_name(const char* name);
 
 void fatso_dependency_graph_get_conflicts(struct fatso_dependency_graph*, fatso_conflicts_t* out_conflicts);
 void fatso_dependency_graph_get_unknown_dependencies(struct fatso_dependency_graph*, fatso_unknown_dependencies_t* out_deps);
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h> // strtod, strtoul
 
 typedef struct named_comand {
   const char* name;
@@ -30,10 +31,15 @@ main(int argc, char* const* argv)
     static struct option long_options[] = {
       {"home", required_argument, NULL, 'H'},
       {"work", required_argument, NULL, 'C'},
+      {"resolve-jobs", required_argument, NULL, 'j'},
+      {"resolve-stats", optional_argument, NULL, 'S'},
+      {"resolve-order", required_argument, NULL, 'O'},
+      {"resolve-timeout", required_argument, NULL, 'T'},
+      {"resolve-max-candidates", required_argument, NULL, 'M'},
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    c = getopt_long(argc, argv, "H:C:", long_options, &option_index);
+    c = getopt_long(argc, argv, "H:C:j:", long_options, &option_index);
     if (c == -1)
       break;
     switch (c) {
@@ -43,6 +49,51 @@ main(int argc, char* const* argv)
       case 'C':
         fatso_set_project_directory(&fatso, optarg);
         break;
+      case 'j': {
+        char* end;
+        unsigned long jobs = strtoul(optarg, &end, 10);
+        if (*optarg == '\0' || *end != '\0' || *optarg == '-' || jobs < 1 || jobs > FATSO_MAX_RESOLVE_JOBS) {
+          fatso_logf(&fatso, FATSO_LOG_FATAL, "Invalid number of jobs for --resolve-jobs: %s (expected 1 to %d)", optarg, FATSO_MAX_RESOLVE_JOBS);
+          return 1;
+        }
+        fatso.resolve_jobs = jobs;
+        break;
+      }
+      case 'S':
+        if (optarg == NULL || strcmp(optarg, "human") == 0) {
+          fatso.resolve_stats = FATSO_RESOLVE_STATS_HUMAN;
+        } else if (strcmp(optarg, "json") == 0) {
+          fatso.resolve_stats = FATSO_RESOLVE_STATS_JSON;
+        } else {
+          fatso_logf(&fatso, FATSO_LOG_FATAL, "Unknown format for --resolve-stats: %s (expected 'human' or 'json')", optarg);
+          return 1;
+        }
+        break;
+      case 'O':
+        fatso.resolve_heuristic = fatso_decision_heuristic_by_name(optarg);
+        if (fatso.resolve_heuristic == NULL) {
+          fatso_logf(&fatso, FATSO_LOG_FATAL, "Unknown order for --resolve-order: %s (expected 'name' or 'most-constrained')", optarg);
+          return 1;
+        }
+        break;
+      case 'T': {
+        char* end;
+        fatso.resolve_timeout = strtod(optarg, &end);
+        if (*optarg == '\0' || *end != '\0' || !(fatso.resolve_timeout > 0)) {
+          fatso_logf(&fatso, FATSO_LOG_FATAL, "Invalid number of seconds for --resolve-timeout: %s (expected more than 0)", optarg);
+          return 1;
+        }
+        break;
+      }
+      case 'M': {
+        char* end;
+        fatso.resolve_max_candidates = strtoul(optarg, &end, 10);
+        if (*optarg == '\0' || *end != '\0' || *optarg == '-') {
+          fatso_logf(&fatso, FATSO_LOG_FATAL, "Invalid number for --resolve-max-candidates: %s", optarg);
+          return 1;
+        }
+        break;
+      }
       default: {
         if (argv[optind]) {
           char* append = strdup(argv[optind]);
@@ -12,6 +12,7 @@ fatso_alloc(size_t size) {
 void*
 fatso_calloc(size_t count, size_t size) {
   if (size && count) {
+    FATSO_STAT_ADD(bytes_requested, count * size);
     void* ptr = calloc(count, size);
     if (ptr == NULL) {
       perror("calloc");
@@ -25,6 +26,8 @@ fatso_calloc(size_t count, size_t size) {
 void*
 fatso_reallocf(void* ptr, size_t size) {
   if (size) {
+    // The old size isn't known here, so the whole new size counts.
+    FATSO_STAT_ADD(bytes_requested, size);
     #if defined(__linux)
     void* new_ptr = realloc(ptr, size);
     if (!new_ptr) {
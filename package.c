@@ -46,6 +46,7 @@ fatso_package_destroy(struct fatso_package* p) {
   fatso_version_destroy(&p->version);
   fatso_free(p->author);
   fatso_free(p->toolchain);
+  fatso_free(p->path);
   fatso_configuration_destroy(&p->base_configuration);
   for (size_t i = 0; i < p->configurations.size; ++i) {
     fatso_configuration_destroy(&p->configurations.data[i]);
@@ -54,10 +55,13 @@ fatso_package_destroy(struct fatso_package* p) {
   memset(p, 0, sizeof(*p));
 }
 
-int fatso_package_parse(struct fatso_package* p, struct yaml_document_s* doc, struct yaml_node_s* node, char** out_error_message) {
+// A summary only has what the resolver needs: the name, version and dependencies.
+static int
+parse_package(struct fatso_package* p, struct yaml_document_s* doc, struct yaml_node_s* node, bool summary, char** out_error_message) {
   yaml_node_t* name_node = fatso_yaml_mapping_lookup(doc, node, "project");
   if (name_node) {
     p->name = fatso_yaml_scalar_strdup(name_node);
+    p->name_id = fatso_intern(p->name);
   }
 
   yaml_node_t* version_node = fatso_yaml_mapping_lookup(doc, node, "version");
@@ -67,29 +71,37 @@ int fatso_package_parse(struct fatso_package* p, struct yaml_document_s* doc, st
     fatso_free(version);
   }
 
-  yaml_node_t* author_node = fatso_yaml_mapping_lookup(doc, node, "author");
-  if (author_node) {
-    p->author = fatso_yaml_scalar_strdup(author_node);
-  }
+  int r = 0;
 
-  yaml_node_t* toolchain_node = fatso_yaml_mapping_lookup(doc, node, "toolchain");
-  if (toolchain_node) {
-    p->toolchain = fatso_yaml_scalar_strdup(toolchain_node);
-  }
+  if (summary) {
+    p->is_summary = true;
+  } else {
+    yaml_node_t* author_node = fatso_yaml_mapping_lookup(doc, node, "author");
+    if (author_node) {
+      p->author = fatso_yaml_scalar_strdup(author_node);
+    }
 
-  int r = 0;
+    yaml_node_t* toolchain_node = fatso_yaml_mapping_lookup(doc, node, "toolchain");
+    if (toolchain_node) {
+      p->toolchain = fatso_yaml_scalar_strdup(toolchain_node);
+    }
 
-  yaml_node_t* source_node = fatso_yaml_mapping_lookup(doc, node, "source");
-  if (source_node) {
-    p->source = fatso_alloc(sizeof(struct fatso_source));
-    r = fatso_source_parse(p->source, doc, source_node, out_error_message);
-    if (r != 0) {
-      fatso_free(p->source);
-      goto out;
+    yaml_node_t* source_node = fatso_yaml_mapping_lookup(doc, node, "source");
+    if (source_node) {
+      p->source = fatso_alloc(sizeof(struct fatso_source));
+      r = fatso_source_parse(p->source, doc, source_node, out_error_message);
+      if (r != 0) {
+        fatso_free(p->source);
+        goto out;
+      }
     }
   }
 
-  r = fatso_configuration_parse(&p->base_configuration, doc, node, out_error_message);
+  if (summary) {
+    r = fatso_configuration_parse_dependencies(&p->base_configuration, doc, node, out_error_message);
+  } else {
+    r = fatso_configuration_parse(&p->base_configuration, doc, node, out_error_message);
+  }
   if (r != 0)
     goto out;
 
@@ -99,7 +111,12 @@ int fatso_package_parse(struct fatso_package* p, struct yaml_document_s* doc, st
     p->configurations.size = len;
     p->configurations.data = fatso_calloc(len, sizeof(struct fatso_configuration));
     for (size_t i = 0; i < len; ++i) {
-      r = fatso_configuration_parse(&p->configurations.data[i], doc, fatso_yaml_sequence_lookup(doc, configurations_node, i), out_error_message);
+      yaml_node_t* configuration_node = fatso_yaml_sequence_lookup(doc, configurations_node, i);
+      if (summary) {
+        r = fatso_configuration_parse_dependencies(&p->configurations.data[i], doc, configuration_node, out_error_message);
+      } else {
+        r = fatso_configuration_parse(&p->configurations.data[i], doc, configuration_node, out_error_message);
+      }
       if (r != 0)
         goto out;
     }
@@ -110,17 +127,22 @@ out:
 }
 
 int
-parse_package_from_document(struct fatso_package* p, struct yaml_document_s* doc, char** out_error_message) {
+fatso_package_parse(struct fatso_package* p, struct yaml_document_s* doc, struct yaml_node_s* node, char** out_error_message) {
+  return parse_package(p, doc, node, false, out_error_message);
+}
+
+static int
+parse_package_from_document(struct fatso_package* p, struct yaml_document_s* doc, bool summary, char** out_error_message) {
   yaml_node_t* root = yaml_document_get_root_node(doc);
   if (root == NULL) {
     *out_error_message = strdup("YAML file does not contain a document.");
     return 1;
   }
-  return fatso_package_parse(p, doc, root, out_error_message);
+  return parse_package(p, doc, root, summary, out_error_message);
 }
 
-int
-fatso_package_parse_from_file(struct fatso_package* p, FILE* fp, char** out_error_message) {
+static int
+parse_package_from_file(struct fatso_package* p, FILE* fp, bool summary, char** out_error_message) {
   int r = 1;
   yaml_parser_t parser;
   yaml_document_t doc;
@@ -131,13 +153,23 @@ fatso_package_parse_from_file(struct fatso_package* p, FILE* fp, char** out_erro
     goto out;
   }
 
-  r = parse_package_from_document(p, &doc, out_error_message);
+  r = parse_package_from_document(p, &doc, summary, out_error_message);
   yaml_document_delete(&doc);
 out:
   yaml_parser_delete(&parser);
   return r;
 }
 
+int
+fatso_package_parse_from_file(struct fatso_package* p, FILE* fp, char** out_error_message) {
+  return parse_package_from_file(p, fp, false, out_error_message);
+}
+
+int
+fatso_package_parse_summary_from_file(struct fatso_package* p, FILE* fp, char** out_error_message) {
+  return parse_package_from_file(p, fp, true, out_error_message);
+}
+
 int
 fatso_package_parse_from_string(struct fatso_package* p, const char* buffer, char** out_error_message) {
   int r = 1;
@@ -150,7 +182,7 @@ fatso_package_parse_from_string(struct fatso_package* p, const char* buffer, cha
     goto out;
   }
 
-  r = parse_package_from_document(p, &doc, out_error_message);
+  r = parse_package_from_document(p, &doc, false, out_error_message);
   yaml_document_delete(&doc);
 out:
   yaml_parser_delete(&parser);
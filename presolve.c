@@ -0,0 +1,148 @@
+#include "internal.h"
+
+/*
+  A version can only be installed if each of its dependencies is satisfied by
+  some version that can be installed in turn. The presolve starts out with
+  every version alive, and then kills the versions with a dependency that no
+  live version satisfies, until there are none left to kill. A live version
+  may still conflict with whatever else a project needs, but a dead one can
+  never be installed, so the resolver doesn't have to try it.
+
+  Dependencies on packages that aren't in the repository don't kill anything:
+  the resolver has to run into them to report them as unknown.
+
+  Along the way, each dependency gets a bitmap of the live versions it's
+  compatible with, so the resolver can intersect those instead of matching
+  constraints against versions.
+*/
+
+typedef FATSO_ARRAY(struct fatso_dependency*) dependency_list_t;
+
+static void
+collect_dependencies(struct fatso_package* package, dependency_list_t* deps) {
+  deps->size = 0;
+  for (size_t c = 0; c <= package->configurations.size; ++c) {
+    struct fatso_configuration* config = c == 0 ? &package->base_configuration : &package->configurations.data[c - 1];
+    for (size_t i = 0; i < config->dependencies.size; ++i) {
+      struct fatso_dependency* dep = &config->dependencies.data[i];
+      fatso_push_back_v(deps, &dep);
+    }
+  }
+}
+
+static void
+match_versions(struct fatso_dependency* dep, const struct fatso_package_versions* target) {
+  fatso_free(dep->compatible.data);
+  dep->compatible.size = (target->size + 63) / 64;
+  dep->compatible.data = fatso_calloc(dep->compatible.size + 1, sizeof(uint64_t));
+  for (size_t i = 0; i < target->size; ++i) {
+    if (fatso_version_range_contains(&dep->range, &target->data[i].version)) {
+      dep->compatible.data[i / 64] |= 1ull << (i % 64);
+    }
+  }
+}
+
+// Clears the bits of the dead versions of `target`, and returns false if no bit is left.
+static bool
+remove_dead_versions(struct fatso_dependency* dep, const struct fatso_package_versions* target) {
+  bool any_left = false;
+  for (size_t w = 0; w < dep->compatible.size; ++w) {
+    uint64_t bits = dep->compatible.data[w];
+    for (uint64_t left = bits; left; left &= left - 1) {
+      size_t i = w * 64 + __builtin_ctzll(left);
+      if (target->data[i].is_dead) {
+        bits &= ~(1ull << (i % 64));
+      }
+    }
+    dep->compatible.data[w] = bits;
+    any_left = any_left || bits != 0;
+  }
+  return any_left;
+}
+
+struct presolve {
+  struct fatso_package_versions* packages;
+  size_t* by_name; // which of `packages` each name ID is, plus one, or 0 if it isn't in the repository
+  size_t num_names;
+};
+
+static const struct fatso_package_versions*
+find_target(const struct presolve* ps, const struct fatso_dependency* dep) {
+  size_t i = dep->name_id < ps->num_names ? ps->by_name[dep->name_id] : 0;
+  return i ? &ps->packages[i - 1] : NULL;
+}
+
+size_t
+fatso_presolve(struct fatso_package_versions* packages, size_t num_packages) {
+  for (size_t i = 0; i < num_packages; ++i) {
+    fatso_intern(packages[i].name);
+  }
+  struct presolve ps = {
+    .packages = packages,
+    .num_names = fatso_interned_name_limit(),
+  };
+  ps.by_name = fatso_calloc(ps.num_names, sizeof(size_t));
+  for (size_t i = 0; i < num_packages; ++i) {
+    ps.by_name[fatso_intern(packages[i].name)] = i + 1;
+  }
+
+  dependency_list_t deps = {0};
+  for (size_t p = 0; p < num_packages; ++p) {
+    for (size_t v = 0; v < packages[p].size; ++v) {
+      struct fatso_package* version = &packages[p].data[v];
+      version->is_dead = false;
+      collect_dependencies(version, &deps);
+      for (size_t i = 0; i < deps.size; ++i) {
+        const struct fatso_package_versions* target = find_target(&ps, deps.data[i]);
+        if (target) {
+          match_versions(deps.data[i], target);
+        }
+      }
+    }
+  }
+
+  // A version that dies can take the versions that depend on it down with it,
+  // so this goes on until nothing changes.
+  size_t num_dead = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t p = 0; p < num_packages; ++p) {
+      for (size_t v = 0; v < packages[p].size; ++v) {
+        struct fatso_package* version = &packages[p].data[v];
+        if (version->is_dead)
+          continue;
+        collect_dependencies(version, &deps);
+        for (size_t i = 0; i < deps.size; ++i) {
+          const struct fatso_package_versions* target = find_target(&ps, deps.data[i]);
+          if (target && !remove_dead_versions(deps.data[i], target)) {
+            version->is_dead = true;
+            changed = true;
+            ++num_dead;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // The bitmaps of dead versions' dependencies stopped being updated when
+  // they died, so they catch up here.
+  for (size_t p = 0; p < num_packages; ++p) {
+    for (size_t v = 0; v < packages[p].size; ++v) {
+      if (!packages[p].data[v].is_dead)
+        continue;
+      collect_dependencies(&packages[p].data[v], &deps);
+      for (size_t i = 0; i < deps.size; ++i) {
+        const struct fatso_package_versions* target = find_target(&ps, deps.data[i]);
+        if (target) {
+          remove_dead_versions(deps.data[i], target);
+        }
+      }
+    }
+  }
+
+  fatso_free(deps.data);
+  fatso_free(ps.by_name);
+  return num_dead;
+}
@@ -5,6 +5,8 @@
 #include <yaml.h>
 #include <errno.h>
 #include <ctype.h> // isspace
+#include <stdint.h> // uint64_t
+#include <unistd.h> // close, unlink
 
 static char*
 project_build_path(struct fatso* f, struct fatso_package* package) {
@@ -31,6 +33,9 @@ void
 fatso_project_destroy(struct fatso_project* p) {
   fatso_free(p->path);
   p->path = NULL;
+  fatso_free(p->install_order.data);
+  fatso_free(p->install_levels.data);
+  fatso_free(p->preferred_versions.data);
   fatso_package_destroy(&p->package);
 }
 
@@ -108,66 +113,621 @@ error:
   goto out;
 }
 
+/*
+  fatso.lock.yml records the install order of the last successful resolve,
+  together with a hash of the fatso.yml it was resolved for:
+
+    manifest: 8c3a1e0b5d2f4a67
+    versions:
+    - ['libyaml', '0.1.6', 'tarball:http://pyyaml.org/download/libyaml/yaml-0.1.6.tar.gz']
+
+  As long as fatso.yml is unchanged and every locked version is still in the
+  repository with the same source, the lock file is used instead of running
+  the resolver.
+
+  Resolutions are also cached in the Fatso home directory, in the same format
+  without the manifest, keyed by the root package's dependencies and the
+  revision of the packages repository, which also covers uncommitted edits to
+  its version files. Projects with the same dependencies share an entry.
+*/
+
+static char*
+lockfile_path(struct fatso* f) {
+  char* path;
+  asprintf(&path, "%s/fatso.lock.yml", f->project->path);
+  return path;
+}
+
+static int
+manifest_hash(struct fatso* f, char** out_hash) {
+  int r = 1;
+  char* path;
+  asprintf(&path, "%s/fatso.yml", f->project->path);
+  FILE* fp = fopen(path, "r");
+  if (!fp)
+    goto out;
+
+  uint64_t h = FATSO_HASH_INIT;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    h = fatso_hash(h, buffer, n);
+  }
+  if (!ferror(fp)) {
+    asprintf(out_hash, "%016llx", (unsigned long long)h);
+    r = 0;
+  }
+  fclose(fp);
+out:
+  fatso_free(path);
+  return r;
+}
+
+static uint64_t
+hash_string(uint64_t h, const char* str) {
+  return fatso_hash(h, str, strlen(str) + 1);
+}
+
+static uint64_t
+hash_dependencies(uint64_t h, const struct fatso_configuration* config) {
+  for (size_t i = 0; i < config->dependencies.size; ++i) {
+    const struct fatso_dependency* dep = &config->dependencies.data[i];
+    h = hash_string(h, dep->name);
+    for (size_t j = 0; j < dep->constraints.size; ++j) {
+      const struct fatso_constraint* c = &dep->constraints.data[j];
+      h = hash_string(h, fatso_version_requirement_to_string(c->version_requirement));
+      h = hash_string(h, c->version.string ? c->version.string : "");
+    }
+    h = fatso_hash(h, "", 1);
+  }
+  return fatso_hash(h, "", 1);
+}
+
+// Fails if the packages repository isn't a git checkout, because then there's
+// nothing to tell when the cached resolutions go stale.
+static int
+resolution_cache_path(struct fatso* f, char** out_path) {
+  char* revision;
+  if (fatso_repository_revision(f, &revision) != 0)
+    return 1;
+
+  const struct fatso_package* root = &f->project->package;
+  uint64_t h = hash_string(FATSO_HASH_INIT, revision);
+  h = hash_dependencies(h, &root->base_configuration);
+  for (size_t i = 0; i < root->configurations.size; ++i) {
+    h = hash_string(h, root->configurations.data[i].name ? root->configurations.data[i].name : "");
+    h = hash_dependencies(h, &root->configurations.data[i]);
+  }
+  // The decision order can change which solution is found.
+  if (f->resolve_heuristic && f->resolve_heuristic != &fatso_heuristic_by_name) {
+    h = hash_string(h, f->resolve_heuristic->name);
+  }
+  fatso_free(revision);
+
+  asprintf(out_path, "%s/cache/resolutions/%016llx.yml", fatso_home_directory(f), (unsigned long long)h);
+  return 0;
+}
+
+static char*
+source_identity(struct fatso_source* source) {
+  char* identity;
+  asprintf(&identity, "%s:%s", source->vtbl->type, source->name);
+  return identity;
+}
+
+static void
+write_quoted(FILE* fp, const char* str) {
+  fputc('\'', fp);
+  for (const char* p = str; *p; ++p) {
+    if (*p == '\'') {
+      fputc('\'', fp);
+    }
+    fputc(*p, fp);
+  }
+  fputc('\'', fp);
+}
+
+static void
+write_install_order(FILE* fp, struct fatso_project* project) {
+  fprintf(fp, "versions:\n");
+  for (size_t i = 0; i < project->install_order.size; ++i) {
+    struct fatso_package* p = project->install_order.data[i];
+    fprintf(fp, "- [");
+    write_quoted(fp, p->name);
+    fprintf(fp, ", ");
+    write_quoted(fp, fatso_version_string(&p->version));
+    if (p->source) {
+      char* identity = source_identity(p->source);
+      fprintf(fp, ", ");
+      write_quoted(fp, identity);
+      fatso_free(identity);
+    }
+    fprintf(fp, "]\n");
+  }
+}
+
+static int
+write_lockfile(struct fatso* f) {
+  int r = 1;
+  char* hash = NULL;
+  char* path = lockfile_path(f);
+
+  if (manifest_hash(f, &hash) != 0)
+    goto out;
+
+  FILE* fp = fopen(path, "w");
+  if (!fp) {
+    fatso_logf(f, FATSO_LOG_WARN, "Could not write %s: %s", path, strerror(errno));
+    goto out;
+  }
+  fprintf(fp, "manifest: %s\n", hash);
+  write_install_order(fp, f->project);
+  r = fclose(fp) == 0 ? 0 : 1;
+
+out:
+  fatso_free(hash);
+  fatso_free(path);
+  return r;
+}
+
+static int
+write_cached_resolution(struct fatso* f, const char* path) {
+  int r = 1;
+  char* dir = strdup(path);
+  char* tmp_path = NULL;
+  *strrchr(dir, '/') = '\0';
+  if (fatso_mkdir_p(dir) != 0)
+    goto out;
+
+  // Other threads or Fatso processes may be reading the same entry, so it
+  // only appears once it's complete.
+  asprintf(&tmp_path, "%s.XXXXXX", path);
+  int fd = mkstemp(tmp_path);
+  if (fd < 0)
+    goto out;
+  FILE* fp = fdopen(fd, "w");
+  if (!fp) {
+    close(fd);
+    unlink(tmp_path);
+    goto out;
+  }
+  write_install_order(fp, f->project);
+  if (fclose(fp) == 0 && rename(tmp_path, path) == 0) {
+    r = 0;
+  } else {
+    unlink(tmp_path);
+  }
+
+out:
+  fatso_free(tmp_path);
+  fatso_free(dir);
+  return r;
+}
+
+// Finds the exact package version recorded by a lock file entry.
+static struct fatso_package*
+find_locked_package(struct fatso* f, yaml_document_t* doc, yaml_node_t* entry) {
+  struct fatso_package* result = NULL;
+  char* name = NULL;
+  char* version_string = NULL;
+  char* source = NULL;
+
+  yaml_node_t* name_node = fatso_yaml_sequence_lookup(doc, entry, 0);
+  yaml_node_t* version_node = fatso_yaml_sequence_lookup(doc, entry, 1);
+  yaml_node_t* source_node = fatso_yaml_sequence_lookup(doc, entry, 2);
+  if (name_node == NULL || name_node->type != YAML_SCALAR_NODE || version_node == NULL || version_node->type != YAML_SCALAR_NODE)
+    goto out;
+  if (source_node && source_node->type != YAML_SCALAR_NODE)
+    goto out;
+
+  name = fatso_yaml_scalar_strdup(name_node);
+  version_string = fatso_yaml_scalar_strdup(version_node);
+
+  struct fatso_package* versions;
+  ssize_t num_versions = fatso_repository_find_package_versions(f, name, &versions);
+  for (ssize_t i = 0; i < num_versions; ++i) {
+    if (strcmp(fatso_version_string(&versions[i].version), version_string) == 0) {
+      result = &versions[i];
+      break;
+    }
+  }
+  // Loading the package in full can't wait until it's installed: every command
+  // that reads the lock file goes on to use each package's source, defines or
+  // environment, and the source is needed right away to tell if the entry is
+  // still valid. Only the locked packages are looked up, not their dependencies.
+  if (result == NULL || fatso_repository_load_package(f, result) != 0) {
+    result = NULL;
+    goto out;
+  }
+
+  // The package description may have changed since the lock file was written.
+  if (source_node) {
+    source = fatso_yaml_scalar_strdup(source_node);
+  }
+  char* identity = result->source ? source_identity(result->source) : NULL;
+  if ((source == NULL) != (identity == NULL) || (source && strcmp(source, identity) != 0)) {
+    result = NULL;
+  }
+  fatso_free(identity);
+
+out:
+  fatso_free(source);
+  fatso_free(version_string);
+  fatso_free(name);
+  return result;
+}
+
+typedef FATSO_ARRAY(struct fatso_package*) package_list_t;
+
+// Reads the versions from a file written by write_install_order. If
+// `manifest` isn't NULL, the file must have been written for it. Entries that
+// are no longer in the repository are skipped if `skip_missing` is set, and
+// make the whole file invalid otherwise.
+static int
+read_versions(struct fatso* f, const char* path, const char* manifest, bool skip_missing, package_list_t* out_versions) {
+  int r = 1;
+  char* locked_manifest = NULL;
+  yaml_parser_t parser;
+  yaml_document_t doc;
+  package_list_t versions = {0};
+
+  yaml_parser_initialize(&parser);
+
+  FILE* fp = fopen(path, "r");
+  if (!fp)
+    goto out;
+
+  yaml_parser_set_input_file(&parser, fp);
+  if (!yaml_parser_load(&parser, &doc))
+    goto out;
+
+  yaml_node_t* root = yaml_document_get_root_node(&doc);
+  if (root == NULL || root->type != YAML_MAPPING_NODE)
+    goto out_doc;
+
+  if (manifest) {
+    yaml_node_t* manifest_node = fatso_yaml_mapping_lookup(&doc, root, "manifest");
+    if (manifest_node == NULL || manifest_node->type != YAML_SCALAR_NODE)
+      goto out_doc;
+    locked_manifest = fatso_yaml_scalar_strdup(manifest_node);
+    if (strcmp(manifest, locked_manifest) != 0)
+      goto out_doc;
+  }
+
+  yaml_node_t* versions_node = fatso_yaml_mapping_lookup(&doc, root, "versions");
+  if (versions_node == NULL || versions_node->type != YAML_SEQUENCE_NODE)
+    goto out_doc;
+
+  for (size_t i = 0; i < fatso_yaml_sequence_length(versions_node); ++i) {
+    yaml_node_t* entry = fatso_yaml_sequence_lookup(&doc, versions_node, i);
+    if (entry->type != YAML_SEQUENCE_NODE)
+      goto out_doc;
+    struct fatso_package* p = find_locked_package(f, &doc, entry);
+    if (p == NULL) {
+      if (skip_missing)
+        continue;
+      goto out_doc;
+    }
+    fatso_push_back_v(&versions, &p);
+  }
+
+  *out_versions = versions;
+  versions.data = NULL;
+  r = 0;
+
+out_doc:
+  yaml_document_delete(&doc);
+out:
+  yaml_parser_delete(&parser);
+  if (fp) fclose(fp);
+  fatso_free(versions.data);
+  fatso_free(locked_manifest);
+  return r;
+}
+
+// Reads a file written by write_install_order into the project's install
+// order. If `manifest` isn't NULL, the file must have been written for it.
+static int
+read_install_order(struct fatso* f, const char* path, const char* manifest) {
+  package_list_t install_order = {0};
+  if (read_versions(f, path, manifest, false, &install_order) != 0)
+    return 1;
+
+  fatso_install_levels_t install_levels = {0};
+  if (fatso_sort_install_levels(f, install_order.data, install_order.size, &install_levels) != 0) {
+    fatso_free(install_order.data);
+    return 1;
+  }
+
+  fatso_free(f->project->install_order.data);
+  fatso_free(f->project->install_levels.data);
+  f->project->install_order.data = install_order.data;
+  f->project->install_order.size = install_order.size;
+  f->project->install_levels.data = install_levels.data;
+  f->project->install_levels.size = install_levels.size;
+  return 0;
+}
+
+int
+fatso_load_dependency_graph(struct fatso* f) {
+  int r = 1;
+  char* path = lockfile_path(f);
+  char* hash = NULL;
+  if (manifest_hash(f, &hash) == 0) {
+    r = read_install_order(f, path, hash);
+  }
+  fatso_free(hash);
+  fatso_free(path);
+  return r;
+}
+
+static int
+compare_packages_by_name_id(const void* ppa, const void* ppb) {
+  const struct fatso_package* a = *(void**)ppa;
+  const struct fatso_package* b = *(void**)ppb;
+  return a->name_id == b->name_id ? 0 : (a->name_id < b->name_id ? -1 : 1);
+}
+
+/*
+  The versions in the lock file, even a stale one, are what's installed under
+  .fatso. When the project is resolved again, those versions are tried before
+  any other, so adding a dependency doesn't move unrelated packages to newer
+  versions and rebuild everything that depends on them.
+*/
+static void
+load_preferred_versions(struct fatso* f) {
+  struct fatso_project* project = f->project;
+  char* path = lockfile_path(f);
+  package_list_t versions = {0};
+  read_versions(f, path, NULL, true, &versions);
+  fatso_free(project->preferred_versions.data);
+  project->preferred_versions.data = versions.data;
+  project->preferred_versions.size = versions.size;
+  for (size_t i = 0; i < project->preferred_versions.size; ++i) {
+    struct fatso_package* p = project->preferred_versions.data[i];
+    if (p->name_id == 0) {
+      p->name_id = fatso_intern(p->name);
+    }
+  }
+  qsort(project->preferred_versions.data, project->preferred_versions.size, sizeof(struct fatso_package*), compare_packages_by_name_id);
+  fatso_free(path);
+}
+
+static bool
+package_depends_on_any(const struct fatso_package* p, const bool* names) {
+  for (size_t c = 0; c <= p->configurations.size; ++c) {
+    const struct fatso_configuration* config = c == 0 ? &p->base_configuration : &p->configurations.data[c - 1];
+    for (size_t i = 0; i < config->dependencies.size; ++i) {
+      if (names[config->dependencies.data[i].name_id])
+        return true;
+    }
+  }
+  return false;
+}
+
+// Forgets the preferred versions of the named packages, and of every package
+// that depends on them, directly or not.
+static void
+forget_preferred_versions(struct fatso* f, const char* const* names, size_t num_names) {
+  struct fatso_project* project = f->project;
+  // Intern the names first, so the table below has room for them.
+  for (size_t i = 0; i < num_names; ++i) {
+    fatso_intern(names[i]);
+  }
+  bool* upgrade = fatso_calloc(fatso_interned_name_limit(), sizeof(bool));
+  for (size_t i = 0; i < num_names; ++i) {
+    unsigned int name_id = fatso_intern(names[i]);
+    struct fatso_package key = { .name_id = name_id };
+    struct fatso_package* pkey = &key;
+    if (fatso_bsearch_v(&pkey, &project->preferred_versions, compare_packages_by_name_id) == NULL) {
+      fatso_logf(f, FATSO_LOG_WARN, "%s is not installed, so there's nothing to upgrade.", names[i]);
+    }
+    upgrade[name_id] = true;
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < project->preferred_versions.size; ++i) {
+      struct fatso_package* p = project->preferred_versions.data[i];
+      if (!upgrade[p->name_id] && package_depends_on_any(p, upgrade)) {
+        upgrade[p->name_id] = true;
+        changed = true;
+      }
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < project->preferred_versions.size; ++i) {
+    struct fatso_package* p = project->preferred_versions.data[i];
+    if (!upgrade[p->name_id]) {
+      project->preferred_versions.data[kept++] = p;
+    }
+  }
+  project->preferred_versions.size = kept;
+  fatso_free(upgrade);
+}
+
+static double
+start_resolve_stats(struct fatso* f) {
+  // Running out of budget reports the counters, even without --resolve-stats.
+  if (f->resolve_stats != FATSO_RESOLVE_STATS_NONE || f->resolve_timeout > 0 || f->resolve_max_candidates) {
+    fatso_resolve_stats_reset(true);
+  }
+  return fatso_time_ms();
+}
+
+static void
+finish_resolve_stats(struct fatso* f, double t0) {
+  if (f->resolve_stats != FATSO_RESOLVE_STATS_NONE) {
+    g_fatso_stats.resolve_ms = fatso_time_ms() - t0;
+    fatso_resolve_stats_print(stderr, f->resolve_stats == FATSO_RESOLVE_STATS_JSON);
+  }
+}
+
 int
 fatso_load_or_generate_dependency_graph(struct fatso* f) {
   int r;
+  double t0 = start_resolve_stats(f);
 
   r = fatso_load_dependency_graph(f);
-  if (r != 0) {
+  if (r == 0) {
+    g_fatso_stats.source = "lockfile";
+  } else {
+    load_preferred_versions(f);
     r = fatso_generate_dependency_graph(f);
   }
+
+  finish_resolve_stats(f, t0);
   return r;
 }
 
 int
-fatso_load_dependency_graph(struct fatso* f) {
-  fatso_logf(f, FATSO_LOG_FATAL, "%s: NIY", __func__);
-  return -1;
+fatso_upgrade_dependency_graph(struct fatso* f, const char* const* names, size_t num_names) {
+  double t0 = start_resolve_stats(f);
+  load_preferred_versions(f);
+  if (num_names > 0) {
+    forget_preferred_versions(f, names, num_names);
+  } else {
+    f->project->preferred_versions.size = 0;
+  }
+  int r = fatso_generate_dependency_graph(f);
+  finish_resolve_stats(f, t0);
+  return r;
+}
+
+static void
+append_conflicts(fatso_strbuf_t* msg, const fatso_conflicts_t* conflicts) {
+  for (size_t i = 0; i < conflicts->size; ++i) {
+    struct fatso_dependency* dep = conflicts->data[i].dependency;
+    fatso_strbuf_printf(msg, "  %s ", dep->name);
+    for (size_t j = 0; j < dep->constraints.size; ++j) {
+      char* constraint = fatso_constraint_to_string(&dep->constraints.data[j]);
+      fatso_strbuf_printf(msg, "%s", constraint);
+      fatso_free(constraint);
+      if (j + 1 < dep->constraints.size) {
+        fatso_strbuf_printf(msg, ", ");
+      }
+    }
+    fatso_strbuf_printf(msg, " (from %s %s)\n", conflicts->data[i].package->name, fatso_version_string(&conflicts->data[i].package->version));
+  }
+}
+
+// The prefetch finds every unknown package any version could depend on, but
+// only the ones the project depends on directly, or that the resolver ran
+// into, are worth reporting.
+static void
+collect_reported_unknowns(const struct fatso_package* root, const bool* is_unknown, struct fatso_dependency_graph* graph, fatso_name_ids_t* out_names) {
+  for (size_t c = 0; c <= root->configurations.size; ++c) {
+    const struct fatso_configuration* config = c == 0 ? &root->base_configuration : &root->configurations.data[c - 1];
+    for (size_t i = 0; i < config->dependencies.size; ++i) {
+      unsigned int name_id = config->dependencies.data[i].name_id;
+      if (is_unknown[name_id]) {
+        fatso_set_insert_v(out_names, &name_id, fatso_compare_name_ids_by_name);
+      }
+    }
+  }
+  if (graph) {
+    fatso_unknown_dependencies_t unknowns = {0};
+    fatso_dependency_graph_get_unknown_dependencies(graph, &unknowns);
+    for (size_t i = 0; i < unknowns.size; ++i) {
+      fatso_set_insert_v(out_names, &unknowns.data[i]->name_id, fatso_compare_name_ids_by_name);
+    }
+    fatso_free(unknowns.data);
+  }
 }
 
 int fatso_generate_dependency_graph(struct fatso* f) {
   int r = 0;
+  bool print_stats = false;
+
+  // A cached resolution doesn't know which versions are installed, so it's
+  // only used when nothing is.
+  char* cache_path = NULL;
+  if (f->project->preferred_versions.size == 0 && resolution_cache_path(f, &cache_path) == 0 && read_install_order(f, cache_path, NULL) == 0) {
+    g_fatso_stats.source = "cache";
+    write_lockfile(f);
+    fatso_free(cache_path);
+    return 0;
+  }
 
+  g_fatso_stats.source = "resolver";
+  double t0 = fatso_time_ms();
+
+  // Everything the project could end up depending on is loaded before the
+  // search starts. If the project itself depends on packages that don't
+  // exist, there's nothing to search, and all of them are reported at once.
+  fatso_name_ids_t unknown = {0};
+  fatso_repository_prefetch(f, &f->project->package, &unknown);
+  bool* is_unknown = fatso_calloc(fatso_interned_name_limit(), sizeof(bool));
+  for (size_t i = 0; i < unknown.size; ++i) {
+    is_unknown[unknown.data[i]] = true;
+  }
   enum fatso_dependency_graph_resolution_status status;
-  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(f, &f->project->package, &status);
+  struct fatso_dependency_graph* graph = NULL;
+  if (package_depends_on_any(&f->project->package, is_unknown)) {
+    status = FATSO_DEPENDENCY_GRAPH_UNKNOWN;
+  } else {
+    graph = fatso_dependency_graph_for_package(f, &f->project->package, &status);
+  }
 
   fatso_strbuf_t msg;
   fatso_strbuf_init(&msg);
 
   switch (status) {
+    case FATSO_DEPENDENCY_GRAPH_BUDGET_EXCEEDED: {
+      g_fatso_stats.resolve_ms = fatso_time_ms() - t0;
+      fatso_strbuf_printf(&msg, "Gave up resolving dependencies after trying %zu candidates in %.1f seconds.\n", g_fatso_stats.candidates, g_fatso_stats.resolve_ms / 1000);
+      fatso_conflicts_t conflicts = {0};
+      fatso_dependency_graph_get_conflicts(graph, &conflicts);
+      if (conflicts.size) {
+        fatso_strbuf_printf(&msg, "The smallest conflict found so far was between:\n");
+        append_conflicts(&msg, &conflicts);
+      }
+      fatso_free(conflicts.data);
+      if (f->resolve_stats == FATSO_RESOLVE_STATS_NONE) {
+        print_stats = true;
+      }
+      r = 1;
+      break;
+    }
     case FATSO_DEPENDENCY_GRAPH_CONFLICT: {
       fatso_strbuf_printf(&msg, "The following dependencies could not be simultaneously met:\n");
 
       fatso_conflicts_t conflicts = {0};
       fatso_dependency_graph_get_conflicts(graph, &conflicts);
-      for (size_t i = 0; i < conflicts.size; ++i) {
-        struct fatso_dependency* dep = conflicts.data[i].dependency;
-        fatso_strbuf_printf(&msg, "  %s ", dep->name);
-        for (size_t j = 0; j < dep->constraints.size; ++j) {
-          fatso_strbuf_printf(&msg, "%s", fatso_constraint_to_string_unsafe(&dep->constraints.data[j]));
-          if (j + 1 < dep->constraints.size) {
-            fatso_strbuf_printf(&msg, ", ");
-          }
-        }
-        fatso_strbuf_printf(&msg, " (from %s %s)\n", conflicts.data[i].package->name, fatso_version_string(&conflicts.data[i].package->version));
-      }
+      append_conflicts(&msg, &conflicts);
+      fatso_free(conflicts.data);
 
       r = 1;
       break;
     }
     case FATSO_DEPENDENCY_GRAPH_UNKNOWN: {
       fatso_strbuf_printf(&msg, "The following packages could not be found in any repository:\n");
-      fatso_unknown_dependencies_t unknowns = {0};
-      fatso_dependency_graph_get_unknown_dependencies(graph, &unknowns);
-      for (size_t i = 0; i < unknowns.size; ++i) {
-        fatso_strbuf_printf(&msg, "  %s\n", unknowns.data[i]->name);
+      fatso_name_ids_t reported = {0};
+      collect_reported_unknowns(&f->project->package, is_unknown, graph, &reported);
+      for (size_t i = 0; i < reported.size; ++i) {
+        fatso_strbuf_printf(&msg, "  %s\n", fatso_interned_name(reported.data[i]));
       }
+      fatso_free(reported.data);
 
       r = 1;
       break;
     }
     case FATSO_DEPENDENCY_GRAPH_SUCCESS: {
-      fatso_dependency_graph_topological_sort(graph, f, &f->project->install_order.data, &f->project->install_order.size);
+      r = fatso_dependency_graph_topological_sort(graph, f, &f->project->install_order.data, &f->project->install_order.size, &f->project->install_levels);
+      if (r != 0)
+        break;
+      // Only the versions chosen are loaded in full, for installing them.
+      for (size_t i = 0; i < f->project->install_order.size && r == 0; ++i) {
+        r = fatso_repository_load_package(f, f->project->install_order.data[i]);
+      }
+      if (r != 0)
+        break;
+      write_lockfile(f);
+      if (cache_path) {
+        write_cached_resolution(f, cache_path);
+      }
       break;
     }
   }
@@ -176,8 +736,16 @@ int fatso_generate_dependency_graph(struct fatso* f) {
     fatso_logz(f, FATSO_LOG_FATAL, message, msg.size);
     fatso_free(message);
   }
+  if (print_stats) {
+    fatso_resolve_stats_print(stderr, false);
+  }
   fatso_strbuf_destroy(&msg);
-  fatso_dependency_graph_free(graph);
+  if (graph) {
+    fatso_dependency_graph_free(graph);
+  }
+  fatso_free(is_unknown);
+  fatso_free(unknown.data);
+  fatso_free(cache_path);
 
   return r;
 }
@@ -6,30 +6,33 @@
 #include <string.h> // strcmp, strerror
 #include <errno.h>
 #include <stdlib.h> // qsort
+#include <pthread.h>
+#include <sys/stat.h> // stat
 
 struct fatso_package_versions_list {
-  char* name;
+  bool loaded;
+  bool unknown;
+  bool from_index; // the versions were loaded from the index written by `fatso sync`
+  struct fatso_package_index cache; // ...or from this package cache, if it's open
   FATSO_ARRAY(struct fatso_package) versions;
+  struct fatso_version_columns* columns; // the same versions, for matching them all at once
+  fatso_version_mask_t live; // the versions that aren't dead, if any are
 };
 
-typedef FATSO_ARRAY(struct fatso_package_versions_list) fatso_package_versions_list_t;
+typedef FATSO_ARRAY(struct fatso_package_versions_list) fatso_package_versions_list_t; // indexed by name ID
 
-int compare_string_to_versions_list(const void* a, const void* b) {
-  const char* str = a;
-  const struct fatso_package_versions_list* p = b;
-  return strcmp(str, p->name);
-}
-
-int compare_versions_lists(const void* a, const void* b) {
-  const struct fatso_package_versions_list* pa = a;
-  const struct fatso_package_versions_list* pb = b;
-  return strcmp(pa->name, pb->name);
-}
+static const char* repository_home_directory(struct fatso*);
+static int read_repository_key(const char* home_directory, char** out_key);
 
+// Files with the same version are kept in the order of their names.
 int compare_packages_by_version(const void* a, const void* b) {
   const struct fatso_package* pa = a;
   const struct fatso_package* pb = b;
-  return fatso_version_compare(&pa->version, &pb->version);
+  int cmp = fatso_version_compare(&pa->version, &pb->version);
+  if (cmp == 0 && pa->path && pb->path) {
+    cmp = strcmp(pa->path, pb->path);
+  }
+  return cmp;
 }
 
 static void
@@ -47,128 +50,934 @@ package_guess_version_from_filename(struct fatso_package* package, const char* p
   }
 }
 
+static struct fatso_version_columns*
+new_version_columns(const struct fatso_package* packages, size_t num_packages) {
+  const struct fatso_version** versions = fatso_calloc(num_packages + 1, sizeof(struct fatso_version*));
+  for (size_t i = 0; i < num_packages; ++i) {
+    versions[i] = &packages[i].version;
+  }
+  struct fatso_version_columns* columns = fatso_alloc(sizeof(struct fatso_version_columns));
+  fatso_version_columns_init(columns, versions, num_packages);
+  fatso_free(versions);
+  return columns;
+}
+
+// Version files are parsed on several threads when there are at least this many for each.
+#define VERSION_FILES_PER_THREAD 16
+
+struct version_file {
+  const char* path;
+  struct fatso_package package;
+  bool parsed;
+  char* error_message;
+};
+
+struct version_files {
+  struct version_file* files;
+  size_t num_files;
+  size_t next_file;
+  bool summaries;
+};
+
+static int
+compare_strings(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void
+parse_version_file(struct version_file* file, bool summaries) {
+  if (!fatso_file_exists(file->path))
+    return;
+  FILE* fp = fopen(file->path, "r");
+  if (fp == NULL) {
+    file->error_message = strdup("Could not open file.");
+    return;
+  }
+  fatso_package_init(&file->package);
+  int r = summaries ? fatso_package_parse_summary_from_file(&file->package, fp, &file->error_message) : fatso_package_parse_from_file(&file->package, fp, &file->error_message);
+  if (r == 0) {
+    if (fatso_version_string(&file->package.version) == NULL) {
+      package_guess_version_from_filename(&file->package, file->path);
+    }
+    file->package.path = strdup(file->path);
+    file->parsed = true;
+  } else {
+    fatso_package_destroy(&file->package);
+  }
+  fclose(fp);
+}
+
+static void*
+version_files_worker(void* userdata) {
+  struct version_files* w = userdata;
+  while (true) {
+    size_t i = __atomic_fetch_add(&w->next_file, 1, __ATOMIC_RELAXED);
+    if (i >= w->num_files)
+      break;
+    parse_version_file(&w->files[i], w->summaries);
+  }
+  return NULL;
+}
+
+// Runs `worker` on up to one thread per core, but no more than `max_jobs`. The
+// calling thread is one of the workers.
+static void
+run_workers(size_t max_jobs, void*(*worker)(void*), void* userdata) {
+  size_t num_jobs = fatso_get_number_of_cpu_cores();
+  if (num_jobs > max_jobs) {
+    num_jobs = max_jobs;
+  }
+  if (num_jobs == 0) {
+    num_jobs = 1;
+  }
+
+  pthread_t* threads = fatso_calloc(num_jobs, sizeof(pthread_t));
+  size_t num_threads = 0;
+  for (; num_threads < num_jobs - 1; ++num_threads) {
+    if (pthread_create(&threads[num_threads], NULL, worker, userdata) != 0)
+      break;
+  }
+  worker(userdata);
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  fatso_free(threads);
+}
+
+static void
+parse_version_files(struct version_files* w) {
+  run_workers(w->num_files / VERSION_FILES_PER_THREAD, version_files_worker, w);
+}
+
 ssize_t
-fatso_repository_find_package_versions(struct fatso* f, const char* name, struct fatso_package** out_packages) {
-  static fatso_package_versions_list_t* g_versions_cache = NULL;
+fatso_repository_parse_package_versions(struct fatso* f, const char* name, bool summaries, struct fatso_package** out_packages) {
+  // Check 'packages' dir:
+  ssize_t r = 0;
+  char* package_dir = NULL;
+  char* pattern = NULL;
+  asprintf(&package_dir, "%s/packages/%s", repository_home_directory(f), name);
+  if (!fatso_directory_exists(package_dir)) {
+    goto error;
+  }
 
-  if (g_versions_cache == NULL) {
-    g_versions_cache = fatso_alloc(sizeof(fatso_package_versions_list_t));
+  // Find all packages in the dir:
+  glob_t g;
+  asprintf(&pattern, "%s/*.yml", package_dir);
+  r = glob(pattern, GLOB_NOSORT, NULL, &g);
+  if (r != 0) {
+    fatso_logf(f, FATSO_LOG_FATAL, "glob: %s", strerror(errno));
+    goto error;
   }
+  qsort(g.gl_pathv, g.gl_pathc, sizeof(char*), compare_strings);
 
-  struct fatso_package_versions_list* list;
-  list = fatso_bsearch_v(name, g_versions_cache, compare_string_to_versions_list);
+  // Parse all package versions, and then collect them in the order of the files:
+  struct version_files w = {
+    .files = fatso_calloc(g.gl_pathc + 1, sizeof(struct version_file)),
+    .num_files = g.gl_pathc,
+    .summaries = summaries,
+  };
+  for (size_t i = 0; i < g.gl_pathc; ++i) {
+    w.files[i].path = g.gl_pathv[i];
+  }
+  parse_version_files(&w);
 
-  if (list == NULL) {
-    struct fatso_package_versions_list l = {
-      .name = strdup(name),
-      .versions = {0},
-    };
-    list = fatso_set_insert_v(g_versions_cache, &l, compare_versions_lists);
-
-    // Check 'packages' dir:
-    int r = 0;
-    char* package_dir = NULL;
-    char* pattern = NULL;
-    asprintf(&package_dir, "%s/packages/%s", fatso_home_directory(f), name);
-    if (!fatso_directory_exists(package_dir)) {
-      goto error;
-    }
-
-    // Find all packages in the dir:
-    glob_t g;
-    asprintf(&pattern, "%s/*.yml", package_dir);
-    r = glob(pattern, GLOB_NOSORT, NULL, &g);
-    if (r != 0) {
-      fatso_logf(f, FATSO_LOG_FATAL, "glob: %s", strerror(errno));
-      goto error;
-    }
-
-    // Allocate the memory for packages:
-    struct fatso_package* packages = fatso_calloc(g.gl_pathc, sizeof(struct fatso_package));
-    size_t valid_i = 0;
-
-    // Load all package versions:
-    for (size_t i = 0; i < g.gl_pathc; ++i) {
-      const char* path = g.gl_pathv[i];
-      struct fatso_package* package = &packages[valid_i];
-
-      if (fatso_file_exists(path)) {
-        FILE* fp = fopen(path, "r");
-        if (fp) {
-          fatso_package_init(package);
-          char* error_message;
-          r = fatso_package_parse_from_file(package, fp, &error_message);
-          if (r == 0) {
-            if (fatso_version_string(&package->version) == NULL) {
-              package_guess_version_from_filename(package, path);
-            }
-            ++valid_i;
-          } else {
-            fatso_logf(f, FATSO_LOG_WARN, "WARNING (%s): %s", path, error_message);
-            free(error_message);
-            fatso_package_destroy(package);
-          }
-          fclose(fp);
-        } else {
-          fatso_logf(f, FATSO_LOG_WARN, "WARNING (%s): Could not open file.", path);
-        }
-      }
+  struct fatso_package* packages = fatso_calloc(g.gl_pathc + 1, sizeof(struct fatso_package));
+  size_t valid_i = 0;
+  for (size_t i = 0; i < w.num_files; ++i) {
+    struct version_file* file = &w.files[i];
+    if (file->parsed) {
+      packages[valid_i++] = file->package;
+    } else if (file->error_message) {
+      fatso_logf(f, FATSO_LOG_WARN, "WARNING (%s): %s", file->path, file->error_message);
+      free(file->error_message);
     }
-    globfree(&g);
+  }
+  fatso_free(w.files);
+  globfree(&g);
 
-    // Sort packages by version:
-    qsort(packages, valid_i, sizeof(struct fatso_package), compare_packages_by_version);
-    list->versions.data = packages;
-    list->versions.size = valid_i;
+  // Sort packages by version:
+  qsort(packages, valid_i, sizeof(struct fatso_package), compare_packages_by_version);
+  *out_packages = packages;
+  r = valid_i;
 
-    goto out;
+  goto out;
 error:
-    r = -1;
+  r = -1;
 out:
-    free(package_dir);
-    free(pattern);
-    if (r < 0) return r;
+  free(package_dir);
+  free(pattern);
+  return r;
+}
+
+struct fatso_repository {
+  unsigned int refcount;
+  char* home_directory;
+  pthread_rwlock_t lock; // lookups only read, unless a package has to be loaded
+  fatso_package_versions_list_t versions;
+  struct fatso_package_index index; // opened once, and never changes after that
+  char* key; // see read_repository_key, or NULL if it isn't a git checkout
+};
+
+static void
+destroy_versions_list(struct fatso_package_versions_list* list) {
+  for (size_t i = 0; i < list->versions.size; ++i) {
+    fatso_package_destroy(&list->versions.data[i]);
+  }
+  fatso_free(list->versions.data);
+  if (list->columns) {
+    fatso_version_columns_destroy(list->columns);
+    fatso_free(list->columns);
   }
+  fatso_free(list->live.data);
+  fatso_package_index_close(&list->cache);
+}
+
+static char*
+index_path(const char* home_directory) {
+  char* path;
+  asprintf(&path, "%s/cache/packages.index", home_directory);
+  return path;
+}
+
+struct fatso_repository*
+fatso_repository_new(const char* home_directory) {
+  struct fatso_repository* repository = fatso_calloc(1, sizeof(struct fatso_repository));
+  repository->refcount = 1;
+  repository->home_directory = strdup(home_directory);
+  pthread_rwlock_init(&repository->lock, NULL);
+
+  // Packages are read from the index if `fatso sync` wrote one for the revision
+  // the repository is at, with the same version files. Reading the key stats
+  // every version file, so it's only done once.
+  if (read_repository_key(home_directory, &repository->key) == 0) {
+    char* path = index_path(home_directory);
+    fatso_package_index_open(&repository->index, path, repository->key);
+    fatso_free(path);
+  }
+  return repository;
+}
+
+struct fatso_repository*
+fatso_repository_retain(struct fatso_repository* repository) {
+  __atomic_add_fetch(&repository->refcount, 1, __ATOMIC_RELAXED);
+  return repository;
+}
+
+void
+fatso_repository_release(struct fatso_repository* repository) {
+  if (repository == NULL || __atomic_sub_fetch(&repository->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+  for (size_t i = 0; i < repository->versions.size; ++i) {
+    destroy_versions_list(&repository->versions.data[i]);
+  }
+  fatso_free(repository->versions.data);
+  fatso_package_index_close(&repository->index);
+  fatso_free(repository->key);
+  pthread_rwlock_destroy(&repository->lock);
+  fatso_free(repository->home_directory);
+  fatso_free(repository);
+}
+
+const char*
+fatso_repository_home_directory(const struct fatso_repository* repository) {
+  return repository->home_directory;
+}
+
+struct fatso_repository*
+fatso_get_repository(struct fatso* f) {
+  struct fatso_repository* repository = __atomic_load_n(&f->repository, __ATOMIC_ACQUIRE);
+  if (repository == NULL) {
+    struct fatso_repository* created = fatso_repository_new(fatso_home_directory(f));
+    if (__atomic_compare_exchange_n(&f->repository, &repository, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      repository = created;
+    } else {
+      fatso_repository_release(created);
+    }
+  }
+  return repository;
+}
+
+// Where the packages repository is, without opening it, so that `fatso sync`
+// can write the index before anything is loaded.
+static const char*
+repository_home_directory(struct fatso* f) {
+  struct fatso_repository* repository = __atomic_load_n(&f->repository, __ATOMIC_ACQUIRE);
+  return repository ? repository->home_directory : fatso_home_directory(f);
+}
+
+int
+fatso_repository_build_index(struct fatso* f) {
+  const char* home_directory = repository_home_directory(f);
+  char* revision = NULL;
+  char* path = index_path(home_directory);
+  char* cache_dir = NULL;
+  char* pattern = NULL;
+  FATSO_ARRAY(char*) names = {0};
+  glob_t g = {0};
+  asprintf(&cache_dir, "%s/cache", home_directory);
+  int r = read_repository_key(home_directory, &revision);
+  if (r != 0)
+    goto out;
+  r = fatso_mkdir_p(cache_dir);
+  if (r != 0) {
+    fatso_logf(f, FATSO_LOG_WARN, "Could not create dir (%s): %s", cache_dir, strerror(errno));
+    goto out;
+  }
+
+  // A package is a directory with at least one version in it.
+  asprintf(&pattern, "%s/packages/*/*.yml", home_directory);
+  r = glob(pattern, GLOB_NOSORT, NULL, &g);
+  if (r != 0 && r != GLOB_NOMATCH) {
+    fatso_logf(f, FATSO_LOG_WARN, "glob: %s", strerror(errno));
+    goto out;
+  }
+  for (size_t i = 0; i < g.gl_pathc; ++i) {
+    char* dir = strdup(g.gl_pathv[i]);
+    *strrchr(dir, '/') = '\0';
+    char* name = strrchr(dir, '/') + 1;
+    if (fatso_bsearch_v(&name, &names, compare_strings) == NULL) {
+      name = strdup(name);
+      fatso_set_insert_v(&names, &name, compare_strings);
+    }
+    fatso_free(dir);
+  }
+
+  r = fatso_package_index_write(f, path, revision, (const char* const*)names.data, names.size, true);
+  if (r != 0) {
+    fatso_logf(f, FATSO_LOG_WARN, "Could not write package index (%s): %s", path, strerror(errno));
+    goto out;
+  }
+
+  // A repository that's already open still has the old index mapped, and the
+  // packages it read from it, so it's opened again.
+  if (f->repository) {
+    struct fatso_repository* reopened = fatso_repository_new(home_directory);
+    fatso_set_repository(f, reopened);
+    fatso_repository_release(reopened);
+  }
+out:
+  globfree(&g);
+  for (size_t i = 0; i < names.size; ++i) {
+    fatso_free(names.data[i]);
+  }
+  fatso_free(names.data);
+  fatso_free(revision);
+  fatso_free(path);
+  fatso_free(cache_dir);
+  fatso_free(pattern);
+  return r;
+}
+
+// Hashes the paths and stat info of the version files matching `pattern`, so
+// that editing, adding or removing one changes the hash.
+static int
+hash_version_files(const char* pattern, uint64_t* out_hash) {
+  glob_t g;
+  int r = glob(pattern, GLOB_NOSORT, NULL, &g);
+  if (r != 0)
+    return 1;
+  qsort(g.gl_pathv, g.gl_pathc, sizeof(char*), compare_strings);
+
+  uint64_t h = FATSO_HASH_INIT;
+  for (size_t i = 0; i < g.gl_pathc && r == 0; ++i) {
+    struct stat st;
+    r = stat(g.gl_pathv[i], &st);
+#if defined(__APPLE__)
+    uint64_t mtime_ns = st.st_mtimespec.tv_nsec;
+#else
+    uint64_t mtime_ns = st.st_mtim.tv_nsec;
+#endif
+    uint64_t fields[] = { st.st_ino, st.st_size, st.st_mtime, mtime_ns };
+    h = fatso_hash(h, g.gl_pathv[i], strlen(g.gl_pathv[i]) + 1);
+    h = fatso_hash(h, fields, sizeof(fields));
+  }
+  globfree(&g);
+  if (r != 0)
+    return 1;
+  *out_hash = h;
+  return 0;
+}
+
+int
+fatso_repository_package_cache_key(struct fatso* f, const char* name, char** out_key) {
+  char* pattern;
+  asprintf(&pattern, "%s/packages/%s/*.yml", repository_home_directory(f), name);
+  uint64_t h;
+  int r = hash_version_files(pattern, &h);
+  fatso_free(pattern);
+  if (r != 0)
+    return 1;
+  asprintf(out_key, "%016llx", (unsigned long long)h);
+  return 0;
+}
+
+char*
+fatso_repository_package_cache_path(struct fatso* f, const char* name) {
+  char* path;
+  asprintf(&path, "%s/cache/packages/%s.index", repository_home_directory(f), name);
+  return path;
+}
+
+// Otherwise, each package is cached on its own, for as long as its version files stay the same.
+static int
+open_package_cache(struct fatso* f, const char* name, struct fatso_package_index* cache) {
+  char* key = NULL;
+  char* path = NULL;
+  char* dir = NULL;
+  int r = fatso_repository_package_cache_key(f, name, &key);
+  if (r != 0)
+    goto out;
+  path = fatso_repository_package_cache_path(f, name);
+  if (fatso_package_index_open(cache, path, key) == 0)
+    goto out;
+
+  dir = strdup(path);
+  *strrchr(dir, '/') = '\0';
+  r = fatso_mkdir_p(dir);
+  if (r == 0) {
+    r = fatso_package_index_write(f, path, key, &name, 1, false);
+  }
+  if (r == 0) {
+    r = fatso_package_index_open(cache, path, key);
+  }
+out:
+  fatso_free(key);
+  fatso_free(path);
+  fatso_free(dir);
+  return r;
+}
+
+static ssize_t
+load_package_summaries(struct fatso* f, struct fatso_repository* repository, const char* name, struct fatso_package_versions_list* list, struct fatso_package** out_packages) {
+  if (repository->index.data) {
+    list->from_index = true;
+    return fatso_package_index_load_versions(&repository->index, name, true, out_packages);
+  }
+  if (open_package_cache(f, name, &list->cache) == 0)
+    return fatso_package_index_load_versions(&list->cache, name, true, out_packages);
+  return fatso_repository_parse_package_versions(f, name, true, out_packages);
+}
+
+static void
+load_versions_list(struct fatso* f, struct fatso_repository* repository, unsigned int name_id, struct fatso_package_versions_list* list) {
+  list->loaded = true;
+  struct fatso_package* packages = NULL;
+  ssize_t num_packages = load_package_summaries(f, repository, fatso_interned_name(name_id), list, &packages);
+  if (num_packages < 0) {
+    list->unknown = true;
+  } else {
+    list->versions.data = packages;
+    list->versions.size = num_packages;
+    list->columns = new_version_columns(packages, num_packages);
+    for (ssize_t i = 0; i < num_packages; ++i) {
+      if (!packages[i].is_dead)
+        continue;
+      if (list->live.data == NULL) {
+        list->live.size = (num_packages + 63) / 64;
+        list->live.data = fatso_alloc(list->live.size * sizeof(uint64_t));
+        memset(list->live.data, 0xff, list->live.size * sizeof(uint64_t));
+      }
+      list->live.data[i / 64] &= ~(1ull << (i % 64));
+    }
+  }
+}
+
+static const struct fatso_package_versions_list*
+find_versions_list_locked(const struct fatso_repository* repository, unsigned int name_id) {
+  if (name_id < repository->versions.size && repository->versions.data[name_id].loaded)
+    return &repository->versions.data[name_id];
+  return NULL;
+}
+
+static ssize_t
+versions_list_result(const struct fatso_package_versions_list* list, struct fatso_package** out_packages, const struct fatso_version_columns** out_columns, const uint64_t** out_live) {
+  if (list->unknown)
+    return -1;
 
   *out_packages = list->versions.data;
+  if (out_columns) {
+    *out_columns = list->columns;
+  }
+  if (out_live) {
+    *out_live = list->live.data;
+  }
   return list->versions.size;
 }
 
+static ssize_t
+find_package_versions_with_columns(struct fatso* f, unsigned int name_id, struct fatso_package** out_packages, const struct fatso_version_columns** out_columns, const uint64_t** out_live) {
+  struct fatso_repository* repository = fatso_get_repository(f);
+  ssize_t r = -1;
+  pthread_rwlock_rdlock(&repository->lock);
+  const struct fatso_package_versions_list* list = find_versions_list_locked(repository, name_id);
+  if (list) {
+    FATSO_STAT_ADD(repository_hits, 1);
+    r = versions_list_result(list, out_packages, out_columns, out_live);
+  }
+  pthread_rwlock_unlock(&repository->lock);
+  if (list)
+    return r;
+
+  // Packages are loaded without holding the lock, so that lookups of other
+  // packages go on meanwhile. If another thread loads the same package first,
+  // its versions are the ones kept.
+  FATSO_STAT_ADD(repository_misses, 1);
+  struct fatso_package_versions_list loaded = {0};
+  load_versions_list(f, repository, name_id, &loaded);
+
+  pthread_rwlock_wrlock(&repository->lock);
+  if (name_id >= repository->versions.size) {
+    size_t old_size = repository->versions.size;
+    repository->versions.size = fatso_interned_name_limit();
+    repository->versions.data = fatso_reallocf(repository->versions.data, repository->versions.size * sizeof(struct fatso_package_versions_list));
+    memset(repository->versions.data + old_size, 0, (repository->versions.size - old_size) * sizeof(struct fatso_package_versions_list));
+  }
+  struct fatso_package_versions_list* slot = &repository->versions.data[name_id];
+  if (slot->loaded) {
+    destroy_versions_list(&loaded);
+  } else {
+    *slot = loaded;
+  }
+  r = versions_list_result(slot, out_packages, out_columns, out_live);
+  pthread_rwlock_unlock(&repository->lock);
+  return r;
+}
+
+static ssize_t
+find_package_versions(struct fatso* f, unsigned int name_id, struct fatso_package** out_packages) {
+  return find_package_versions_with_columns(f, name_id, out_packages, NULL, NULL);
+}
+
+ssize_t
+fatso_repository_find_package_versions(struct fatso* f, const char* name, struct fatso_package** out_packages) {
+  return find_package_versions(f, fatso_intern(name), out_packages);
+}
+
+struct prefetch {
+  struct fatso* f;
+  const unsigned int* name_ids;
+  size_t num_names;
+  size_t next_name;
+};
+
+static void*
+prefetch_worker(void* userdata) {
+  struct prefetch* w = userdata;
+  while (true) {
+    size_t i = __atomic_fetch_add(&w->next_name, 1, __ATOMIC_RELAXED);
+    if (i >= w->num_names)
+      break;
+    struct fatso_package* packages;
+    find_package_versions(w->f, w->name_ids[i], &packages);
+  }
+  return NULL;
+}
+
+static int
+compare_name_ids(const void* a, const void* b) {
+  unsigned int x = *(const unsigned int*)a;
+  unsigned int y = *(const unsigned int*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Appends the names `package` depends on that haven't been seen yet to `names`.
+static void
+add_unseen_dependency_names(const struct fatso_package* package, fatso_name_ids_t* seen, fatso_name_ids_t* names) {
+  for (size_t c = 0; c <= package->configurations.size; ++c) {
+    const struct fatso_configuration* config = c == 0 ? &package->base_configuration : &package->configurations.data[c - 1];
+    for (size_t i = 0; i < config->dependencies.size; ++i) {
+      unsigned int name_id = config->dependencies.data[i].name_id;
+      if (fatso_bsearch_v(&name_id, seen, compare_name_ids) == NULL) {
+        fatso_set_insert_v(seen, &name_id, compare_name_ids);
+        fatso_append_v(names, &name_id, 1);
+      }
+    }
+  }
+}
+
+void
+fatso_repository_prefetch(struct fatso* f, const struct fatso_package* package, fatso_name_ids_t* out_unknown) {
+  fatso_get_repository(f);
+  fatso_name_ids_t seen = {0};
+  fatso_name_ids_t names = {0};
+  fatso_name_ids_t next_names = {0};
+  add_unseen_dependency_names(package, &seen, &names);
+
+  // Each round loads the packages the previous round's packages depend on.
+  while (names.size > 0) {
+    struct prefetch w = {
+      .f = f,
+      .name_ids = names.data,
+      .num_names = names.size,
+    };
+    run_workers(names.size, prefetch_worker, &w);
+    FATSO_STAT_ADD(prefetched, names.size);
+
+    next_names.size = 0;
+    for (size_t i = 0; i < names.size; ++i) {
+      struct fatso_package* versions;
+      ssize_t num_versions = find_package_versions(f, names.data[i], &versions);
+      if (num_versions < 0 && out_unknown) {
+        fatso_set_insert_v(out_unknown, &names.data[i], fatso_compare_name_ids_by_name);
+      }
+      for (ssize_t j = 0; j < num_versions; ++j) {
+        add_unseen_dependency_names(&versions[j], &seen, &next_names);
+      }
+    }
+    fatso_name_ids_t tmp = names;
+    names = next_names;
+    next_names = tmp;
+  }
+
+  fatso_free(seen.data);
+  fatso_free(names.data);
+  fatso_free(next_names.data);
+}
+
+// The index of the first of the sorted `packages` that isn't older than `version`.
+static size_t
+first_not_older(const struct fatso_package* packages, size_t num_packages, const struct fatso_version* version) {
+  size_t begin = 0;
+  size_t end = num_packages;
+  while (begin < end) {
+    size_t mid = begin + (end - begin) / 2;
+    if (fatso_version_compare(&packages[mid].version, version) < 0) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return begin;
+}
+
+// The index of the first of the sorted `packages` that's above `range`.
+static size_t
+first_above_range(const struct fatso_package* packages, size_t num_packages, const struct fatso_version_range* range) {
+  size_t begin = 0;
+  size_t end = num_packages;
+  while (begin < end) {
+    size_t mid = begin + (end - begin) / 2;
+    if (fatso_version_range_compare(range, &packages[mid].version) <= 0) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return begin;
+}
+
 enum fatso_repository_result
 fatso_repository_find_package_matching_dependency(struct fatso* f, struct fatso_dependency* dep, struct fatso_version* less_than_version, struct fatso_package** out_package) {
   struct fatso_package* packages = NULL;
-  ssize_t num_versions = fatso_repository_find_package_versions(f, dep->name, &packages);
-  if (num_versions >= 0) {
-    if (num_versions > 0) {
-      struct fatso_package* p = &packages[num_versions - 1];
-
-      if (less_than_version) {
-        while (p >= packages && fatso_version_compare(&p->version, less_than_version) >= 0) {
-          --p;
-        }
-      }
+  const uint64_t* live = NULL;
+  ssize_t num_versions = find_package_versions_with_columns(f, dep->name_id, &packages, NULL, &live);
+  if (num_versions < 0)
+    return FATSO_PACKAGE_UNKNOWN;
+
+  // Versions are sorted, and a range covers a run of them, so the newest match
+  // is the newest live version in the run below both `less_than_version` and
+  // the top of the range, if any.
+  size_t end = first_above_range(packages, num_versions, &dep->range);
+  if (less_than_version) {
+    size_t below = first_not_older(packages, end, less_than_version);
+    end = below < end ? below : end;
+  }
+  for (; end > 0 && fatso_version_range_compare(&dep->range, &packages[end - 1].version) == 0; --end) {
+    size_t i = end - 1;
+    if (live == NULL || (live[i / 64] >> (i % 64)) & 1) {
+      *out_package = &packages[i];
+      return FATSO_PACKAGE_OK;
+    }
+  }
+  return FATSO_PACKAGE_NO_MATCHING_VERSION;
+}
+
+ssize_t
+fatso_repository_match_versions(struct fatso* f, const struct fatso_dependency* dep, struct fatso_package** out_packages, fatso_version_mask_t* inout_mask) {
+  const struct fatso_version_columns* columns = NULL;
+  const uint64_t* live = NULL;
+  ssize_t num_versions = find_package_versions_with_columns(f, dep->name_id, out_packages, &columns, &live);
+  if (num_versions < 0)
+    return -1;
 
-      while (p >= packages) {
-        if (fatso_version_matches_constraints(&p->version, dep->constraints.data, dep->constraints.size)) {
-          *out_package = p;
-          return FATSO_PACKAGE_OK;
-        }
-        --p;
+  size_t num_words = (num_versions + 63) / 64;
+  if (inout_mask->size < num_words) {
+    inout_mask->data = fatso_reallocf(inout_mask->data, num_words * sizeof(uint64_t));
+  }
+  inout_mask->size = num_words;
+
+  // The presolve already matched the dependency against every version.
+  if (dep->compatible.size == num_words && num_words > 0) {
+    FATSO_STAT_ADD(presolved_matches, 1);
+    memcpy(inout_mask->data, dep->compatible.data, num_words * sizeof(uint64_t));
+    return num_versions;
+  }
+
+  if (!fatso_version_range_match_columns(&dep->range, columns, inout_mask->data)) {
+    memset(inout_mask->data, 0, num_words * sizeof(uint64_t));
+    for (ssize_t i = 0; i < num_versions; ++i) {
+      if (fatso_version_range_contains(&dep->range, &(*out_packages)[i].version)) {
+        inout_mask->data[i / 64] |= 1ull << (i % 64);
       }
     }
+  }
+  for (size_t i = 0; live && i < num_words; ++i) {
+    inout_mask->data[i] &= live[i];
+  }
+  return num_versions;
+}
+
+ssize_t
+fatso_repository_cursor_begin(struct fatso* f, const struct fatso_dependency* dep, struct fatso_repository_cursor* cursor) {
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->num_versions = fatso_repository_match_versions(f, dep, &cursor->versions, &cursor->mask);
+  cursor->end = cursor->num_versions > 0 ? cursor->num_versions : 0;
+  return cursor->num_versions;
+}
+
+struct fatso_package*
+fatso_repository_cursor_next(struct fatso_repository_cursor* cursor) {
+  while (cursor->end > 0) {
+    size_t word = (cursor->end - 1) / 64;
+    uint64_t bits = cursor->mask.data[word];
+    size_t bits_below_end = cursor->end - word * 64;
+    if (bits_below_end < 64) {
+      bits &= (1ull << bits_below_end) - 1;
+    }
+    if (bits) {
+      cursor->end = word * 64 + 63 - __builtin_clzll(bits);
+      return &cursor->versions[cursor->end];
+    }
+    cursor->end = word * 64;
+  }
+  return NULL;
+}
 
-    return FATSO_PACKAGE_NO_MATCHING_VERSION;
-  } else {
-    return FATSO_PACKAGE_UNKNOWN;
+bool
+fatso_repository_cursor_remove(struct fatso_repository_cursor* cursor, const struct fatso_package* package) {
+  if (package < cursor->versions || package >= cursor->versions + cursor->end)
+    return false;
+  size_t idx = package - cursor->versions;
+  uint64_t bit = 1ull << (idx % 64);
+  bool found = (cursor->mask.data[idx / 64] & bit) != 0;
+  cursor->mask.data[idx / 64] &= ~bit;
+  return found;
+}
+
+void
+fatso_repository_cursor_destroy(struct fatso_repository_cursor* cursor) {
+  fatso_free(cursor->mask.data);
+  cursor->mask.data = NULL;
+  cursor->mask.size = 0;
+}
+
+ssize_t
+fatso_repository_count_matching_versions(struct fatso* f, struct fatso_dependency* dep) {
+  struct fatso_package* packages = NULL;
+  fatso_version_mask_t mask = {0};
+  ssize_t num_versions = fatso_repository_match_versions(f, dep, &packages, &mask);
+  ssize_t count = 0;
+  for (size_t i = 0; i < mask.size; ++i) {
+    count += __builtin_popcountll(mask.data[i]);
   }
+  fatso_free(mask.data);
+  return num_versions >= 0 ? count : -1;
 }
 
 enum fatso_repository_result
 fatso_repository_find_package(struct fatso* f, const char* name, struct fatso_version* less_than_version, struct fatso_package** out_package) {
   struct fatso_dependency dep = {
-    .name = (char*)name,
+    .name = name,
+    .name_id = fatso_intern(name),
     .constraints = {0},
   };
 
   return fatso_repository_find_package_matching_dependency(f, &dep, less_than_version, out_package);
 }
+
+static void
+move_configuration_details(struct fatso_configuration* into, struct fatso_configuration* from) {
+  into->name = from->name;
+  into->defines = from->defines;
+  into->env = from->env;
+  from->name = NULL;
+  memset(&from->defines, 0, sizeof(from->defines));
+  memset(&from->env, 0, sizeof(from->env));
+}
+
+static int
+parse_full_package(struct fatso* f, const struct fatso_package_index* index, const struct fatso_package* package, struct fatso_package* full) {
+  int r = 1;
+  if (index) {
+    r = fatso_package_index_load_package(index, package->name, fatso_version_string(&package->version), full);
+  } else if (package->path) {
+    FILE* fp = fopen(package->path, "r");
+    if (fp) {
+      char* error_message = NULL;
+      r = fatso_package_parse_from_file(full, fp, &error_message);
+      if (r != 0) {
+        fatso_logf(f, FATSO_LOG_WARN, "WARNING (%s): %s", package->path, error_message);
+        free(error_message);
+      }
+      fclose(fp);
+    }
+  }
+  return r;
+}
+
+// The resolver may still point into the dependencies, so only the rest moves over.
+static void
+move_package_details(struct fatso_package* package, struct fatso_package* full) {
+  package->author = full->author;
+  package->toolchain = full->toolchain;
+  package->source = full->source;
+  full->author = NULL;
+  full->toolchain = NULL;
+  full->source = NULL;
+  move_configuration_details(&package->base_configuration, &full->base_configuration);
+  for (size_t i = 0; i < package->configurations.size; ++i) {
+    move_configuration_details(&package->configurations.data[i], &full->configurations.data[i]);
+  }
+  package->is_summary = false;
+}
+
+// Packages may be shared by several resolutions. They're parsed without
+// holding the lock, and filled in under the write lock; if another thread
+// filled one in first, its details are the ones kept.
+int
+fatso_repository_load_package(struct fatso* f, struct fatso_package* package) {
+  struct fatso_repository* repository = fatso_get_repository(f);
+  int r = 0;
+
+  // Indexes stay mapped for as long as the repository, so a copy can be read unlocked.
+  struct fatso_package_index index = {0};
+  pthread_rwlock_rdlock(&repository->lock);
+  bool is_summary = package->is_summary;
+  const struct fatso_package_versions_list* list = find_versions_list_locked(repository, package->name_id);
+  if (list && list->cache.data) {
+    index = list->cache;
+  } else if (list && list->from_index) {
+    index = repository->index;
+  }
+  pthread_rwlock_unlock(&repository->lock);
+  if (!is_summary)
+    return 0;
+
+  struct fatso_package full;
+  fatso_package_init(&full);
+  r = parse_full_package(f, index.data ? &index : NULL, package, &full);
+  if (r != 0 || full.configurations.size != package->configurations.size) {
+    fatso_logf(f, FATSO_LOG_FATAL, "Could not load %s %s from the packages repository.", package->name, fatso_version_string(&package->version));
+    r = 1;
+    goto out;
+  }
+
+  pthread_rwlock_wrlock(&repository->lock);
+  if (package->is_summary) {
+    move_package_details(package, &full);
+  }
+  pthread_rwlock_unlock(&repository->lock);
+
+out:
+  fatso_package_destroy(&full);
+  return r;
+}
+
+static char*
+read_first_line(const char* path) {
+  FILE* fp = fopen(path, "r");
+  if (!fp)
+    return NULL;
+  char buffer[1024];
+  char* line = fgets(buffer, sizeof(buffer), fp);
+  fclose(fp);
+  if (line == NULL)
+    return NULL;
+  line[strcspn(line, "\r\n")] = '\0';
+  return strdup(line);
+}
+
+// Looks up `ref` in .git/packed-refs, where refs end up after `git gc`.
+static char*
+find_packed_ref(const char* git_dir, const char* ref) {
+  char* result = NULL;
+  char* path;
+  asprintf(&path, "%s/packed-refs", git_dir);
+  FILE* fp = fopen(path, "r");
+  fatso_free(path);
+  if (!fp)
+    return NULL;
+
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), fp)) {
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+    char* space = strchr(buffer, ' ');
+    if (buffer[0] != '#' && buffer[0] != '^' && space && strcmp(space + 1, ref) == 0) {
+      *space = '\0';
+      result = strdup(buffer);
+      break;
+    }
+  }
+  fclose(fp);
+  return result;
+}
+
+static int
+read_revision(const char* home_directory, char** out_revision) {
+  char* git_dir;
+  char* path;
+  asprintf(&git_dir, "%s/packages/.git", home_directory);
+  asprintf(&path, "%s/HEAD", git_dir);
+  char* head = read_first_line(path);
+  fatso_free(path);
+
+  char* revision = head;
+  if (head && strncmp(head, "ref: ", 5) == 0) {
+    const char* ref = head + 5;
+    asprintf(&path, "%s/%s", git_dir, ref);
+    revision = read_first_line(path);
+    fatso_free(path);
+    if (revision == NULL) {
+      revision = find_packed_ref(git_dir, ref);
+    }
+    fatso_free(head);
+  }
+  fatso_free(git_dir);
+
+  if (revision == NULL || revision[0] == '\0') {
+    fatso_free(revision);
+    return 1;
+  }
+  *out_revision = revision;
+  return 0;
+}
+
+// The commit alone doesn't change with uncommitted edits to the version files,
+// so their stat info is hashed in as well.
+static int
+read_repository_key(const char* home_directory, char** out_key) {
+  char* revision = NULL;
+  char* pattern = NULL;
+  uint64_t h;
+  int r = read_revision(home_directory, &revision);
+  if (r != 0)
+    goto out;
+  asprintf(&pattern, "%s/packages/*/*.yml", home_directory);
+  r = hash_version_files(pattern, &h);
+  if (r != 0)
+    goto out;
+  asprintf(out_key, "%s-%016llx", revision, (unsigned long long)h);
+out:
+  fatso_free(revision);
+  fatso_free(pattern);
+  return r;
+}
+
+int
+fatso_repository_revision(struct fatso* f, char** out_revision) {
+  struct fatso_repository* repository = fatso_get_repository(f);
+  if (repository->key == NULL)
+    return 1;
+  *out_revision = strdup(repository->key);
+  return 0;
+}
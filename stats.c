@@ -0,0 +1,56 @@
+#include "fatso.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <string.h> // memset
+
+/*
+  Counters for `--resolve-stats`. They are process-wide, because some of the
+  work they count (allocation, constraint matching) happens far away from any
+  struct fatso, and they're updated atomically, because the resolver may run on
+  several threads. Nothing is counted unless collection has been enabled.
+*/
+
+bool g_fatso_collect_stats = false;
+struct fatso_resolve_stats g_fatso_stats = {0};
+
+void
+fatso_resolve_stats_reset(bool enable) {
+  memset(&g_fatso_stats, 0, sizeof(g_fatso_stats));
+  g_fatso_collect_stats = enable;
+}
+
+#define FOREACH_COUNTER(X) \
+  X(candidates, "Candidates tried") \
+  X(dead_ends, "Known dead ends skipped") \
+  X(backtracks, "Backtracks") \
+  X(backjumps, "Backjumps") \
+  X(nogoods, "Nogoods learned") \
+  X(unsatisfiable, "Unsatisfiable dependencies") \
+  X(graph_copies, "Graph copies") \
+  X(constraint_evaluations, "Constraint evaluations") \
+  X(repository_hits, "Repository cache hits") \
+  X(repository_misses, "Repository cache misses") \
+  X(prefetched, "Packages prefetched") \
+  X(presolved_matches, "Presolved matches") \
+  X(bytes_requested, "Bytes requested (total)")
+
+void
+fatso_resolve_stats_print(FILE* fp, bool json) {
+  const struct fatso_resolve_stats* s = &g_fatso_stats;
+  if (json) {
+    fprintf(fp, "{\"source\": \"%s\", \"resolve_ms\": %.3f", s->source, s->resolve_ms);
+    #define PRINT_JSON(FIELD, DESCRIPTION) \
+      fprintf(fp, ", \"" #FIELD "\": %zu", s->FIELD);
+    FOREACH_COUNTER(PRINT_JSON)
+    #undef PRINT_JSON
+    fprintf(fp, "}\n");
+  } else {
+    fprintf(fp, "Dependency resolution (%s):\n", s->source);
+    fprintf(fp, "  %-24s %.3f ms\n", "Time", s->resolve_ms);
+    #define PRINT_HUMAN(FIELD, DESCRIPTION) \
+      fprintf(fp, "  %-24s %zu\n", DESCRIPTION, s->FIELD);
+    FOREACH_COUNTER(PRINT_HUMAN)
+    #undef PRINT_HUMAN
+  }
+}
@@ -42,6 +42,9 @@ fatso_sync_packages(struct fatso* f) {
     }
   }
 
+  // Not being able to index the packages only makes later commands slower.
+  fatso_repository_build_index(f);
+
 out:
   fatso_free(packages_dir);
   fatso_free(packages_git_dir);
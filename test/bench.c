@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/resource.h>
+
+#include "../internal.h"
+#include "../util.h"
+#include "../fatso.h"
+
+/*
+  Generates a synthetic package repository in the layout that
+  fatso_repository_find_package_versions reads (packages/<name>/<version>.yml),
+  and times loading it, resolving a root package against it, and sorting the
+  result. Every run prints a single line of JSON.
+*/
+
+struct bench_options {
+  unsigned int packages;
+  unsigned int versions;
+  unsigned int fanout;
+  unsigned int conflicts; // percent of dependencies that cap the version range
+  unsigned int depth;
+  unsigned int roots;
+  unsigned int inserts;
+  unsigned int jobs;
+  const char* order;
+  uint64_t seed;
+  const char* dir;
+  bool keep;
+};
+
+static uint64_t
+bench_random(uint64_t* state) {
+  // xorshift64*, so runs are reproducible across platforms.
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned int
+bench_random_below(uint64_t* state, unsigned int n) {
+  return n ? (unsigned int)(bench_random(state) % n) : 0;
+}
+
+static void
+version_name(char* buffer, size_t len, unsigned int idx) {
+  snprintf(buffer, len, "%u.%u.0", idx / 4 + 1, idx % 4);
+}
+
+static void
+package_name(char* buffer, size_t len, unsigned int idx, const struct bench_options* o) {
+  // The last `depth` packages form a chain, each depending on the next.
+  if (idx + o->depth >= o->packages) {
+    snprintf(buffer, len, "chain-%04u", idx + o->depth - o->packages);
+  } else {
+    snprintf(buffer, len, "pkg-%04u", idx);
+  }
+}
+
+static void
+write_constraint(FILE* fp, uint64_t* rng, const struct bench_options* o) {
+  char version[32];
+  if (bench_random_below(rng, 100) < o->conflicts) {
+    // Caps the range somewhere in the lower half, which clashes with the
+    // lower bounds other dependents put on the same package.
+    version_name(version, sizeof(version), 1 + bench_random_below(rng, o->versions / 2 + 1));
+    fprintf(fp, "'< %s'", version);
+    return;
+  }
+
+  unsigned int idx = bench_random_below(rng, o->versions);
+  version_name(version, sizeof(version), idx);
+  switch (bench_random_below(rng, 3)) {
+    case 0: fprintf(fp, "'>= %s'", version); break;
+    case 1: fprintf(fp, "'~> %u.%u'", idx / 4 + 1, idx % 4); break;
+    default: fprintf(fp, "'>= 1.0'"); break;
+  }
+}
+
+static int
+generate_repository(const struct bench_options* o) {
+  uint64_t rng = o->seed;
+  char name[64];
+  char dep_name[64];
+  char version[32];
+
+  for (unsigned int i = 0; i < o->packages; ++i) {
+    package_name(name, sizeof(name), i, o);
+    char* dir;
+    asprintf(&dir, "%s/packages/%s", o->dir, name);
+    int r = fatso_mkdir_p(dir);
+    if (r != 0) {
+      perror("mkdir");
+      fatso_free(dir);
+      return r;
+    }
+
+    bool in_chain = i + o->depth >= o->packages;
+
+    for (unsigned int v = 0; v < o->versions; ++v) {
+      version_name(version, sizeof(version), v);
+      char* path;
+      asprintf(&path, "%s/%s.yml", dir, version);
+      FILE* fp = fopen(path, "w");
+      if (fp == NULL) {
+        perror("fopen");
+        fatso_free(path);
+        fatso_free(dir);
+        return 1;
+      }
+
+      fprintf(fp, "project: %s\nversion: %s\nauthor: Fatso Benchmark\n", name, version);
+      fprintf(fp, "source: http://example.com/%s-%s.tar.gz\n", name, version);
+      fprintf(fp, "dependencies:\n");
+      if (in_chain) {
+        if (i + 1 < o->packages) {
+          package_name(dep_name, sizeof(dep_name), i + 1, o);
+          fprintf(fp, "- [%s, ", dep_name);
+          write_constraint(fp, &rng, o);
+          fprintf(fp, "]\n");
+        }
+      } else {
+        // Only depend on packages with a higher index, so the graph is acyclic.
+        unsigned int remaining = o->packages - i - 1;
+        unsigned int fanout = o->fanout < remaining ? o->fanout : remaining;
+        for (unsigned int d = 0; d < fanout; ++d) {
+          unsigned int dep = i + 1 + bench_random_below(&rng, remaining);
+          package_name(dep_name, sizeof(dep_name), dep, o);
+          fprintf(fp, "- [%s, ", dep_name);
+          write_constraint(fp, &rng, o);
+          fprintf(fp, "]\n");
+        }
+      }
+      fclose(fp);
+      fatso_free(path);
+    }
+    fatso_free(dir);
+  }
+  return 0;
+}
+
+static void
+init_root_package(struct fatso_package* root, const struct bench_options* o) {
+  fatso_package_init(root);
+  root->name = strdup("bench-root");
+  fatso_version_from_string(&root->version, "1.0");
+
+  struct fatso_constraint any = {{0}};
+  fatso_constraint_from_string(&any, ">= 1.0");
+
+  char name[64];
+  unsigned int num_roots = o->roots < o->packages ? o->roots : o->packages;
+  for (unsigned int i = 0; i < num_roots; ++i) {
+    package_name(name, sizeof(name), i, o);
+    struct fatso_dependency dep;
+    fatso_dependency_init(&dep, name, &any, 1);
+    fatso_push_back_v(&root->base_configuration.dependencies, &dep);
+  }
+  if (o->depth && o->depth <= o->packages && num_roots < o->packages - o->depth + 1) {
+    package_name(name, sizeof(name), o->packages - o->depth, o);
+    struct fatso_dependency dep;
+    fatso_dependency_init(&dep, name, &any, 1);
+    fatso_push_back_v(&root->base_configuration.dependencies, &dep);
+  }
+  fatso_constraint_destroy(&any);
+}
+
+static double
+now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static long
+peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+/*
+  Times adding `inserts` distinct dependencies to a dependency graph, in random
+  name order: once into a single graph, and once the way the resolver does it,
+  with every insert going into a fresh copy of the previous graph.
+*/
+static void
+bench_inserts(const struct bench_options* o) {
+  uint64_t rng = o->seed;
+  struct fatso_package root;
+  fatso_package_init(&root);
+  root.name = strdup("bench-root");
+  fatso_version_from_string(&root.version, "1.0");
+
+  struct fatso_constraint any = {{0}};
+  fatso_constraint_from_string(&any, ">= 1.0");
+  struct fatso_dependency* deps = fatso_calloc(o->inserts, sizeof(struct fatso_dependency));
+  for (unsigned int i = 0; i < o->inserts; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "dep-%016llx", (unsigned long long)bench_random(&rng));
+    fatso_dependency_init(&deps[i], name, &any, 1);
+  }
+  fatso_constraint_destroy(&any);
+
+  double t0 = now_ms();
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_new();
+  fatso_dependency_graph_add_closed_set(graph, &root);
+  for (unsigned int i = 0; i < o->inserts; ++i) {
+    fatso_dependency_graph_add_open_set(graph, &deps[i], &root);
+  }
+  double insert_ms = now_ms() - t0;
+  fatso_dependency_graph_free(graph);
+
+  struct fatso_dependency_graph** graphs = fatso_calloc(o->inserts + 1, sizeof(struct fatso_dependency_graph*));
+  t0 = now_ms();
+  graphs[0] = fatso_dependency_graph_new();
+  fatso_dependency_graph_add_closed_set(graphs[0], &root);
+  for (unsigned int i = 0; i < o->inserts; ++i) {
+    graphs[i + 1] = fatso_dependency_graph_copy(graphs[i]);
+    fatso_dependency_graph_add_open_set(graphs[i + 1], &deps[i], &root);
+  }
+  double copy_insert_ms = now_ms() - t0;
+
+  printf("{\"inserts\": %u, \"seed\": %llu, \"insert_ms\": %.3f, \"copy_insert_ms\": %.3f, \"peak_rss_kb\": %ld}\n",
+    o->inserts, (unsigned long long)o->seed, insert_ms, copy_insert_ms, peak_rss_kb());
+
+  for (unsigned int i = 0; i <= o->inserts; ++i) {
+    fatso_dependency_graph_free(graphs[i]);
+  }
+  fatso_free(graphs);
+  for (unsigned int i = 0; i < o->inserts; ++i) {
+    fatso_dependency_destroy(&deps[i]);
+  }
+  fatso_free(deps);
+  fatso_package_destroy(&root);
+}
+
+static int
+remove_entry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+  return remove(path);
+}
+
+static const char*
+status_to_string(enum fatso_dependency_graph_resolution_status status) {
+  switch (status) {
+    case FATSO_DEPENDENCY_GRAPH_SUCCESS: return "success";
+    case FATSO_DEPENDENCY_GRAPH_CONFLICT: return "conflict";
+    case FATSO_DEPENDENCY_GRAPH_UNKNOWN: return "unknown";
+    case FATSO_DEPENDENCY_GRAPH_BUDGET_EXCEEDED: return "budget exceeded";
+  }
+  return "";
+}
+
+static void
+usage(const char* program_name) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "\t--packages N    Number of packages (default: 100)\n"
+    "\t--versions N    Versions per package (default: 8)\n"
+    "\t--fanout N      Dependencies per package version (default: 3)\n"
+    "\t--conflicts P   Percentage of dependencies that cap the version range (default: 0)\n"
+    "\t--depth N       Length of a dependency chain hanging off the root (default: 0)\n"
+    "\t--roots N       Number of packages the root depends on (default: 10)\n"
+    "\t--inserts N     Only time inserting N dependencies into a graph\n"
+    "\t-j, --jobs N    Resolve with N threads (default: 1)\n"
+    "\t--order NAME    Decision order, 'name' or 'most-constrained' (default: name)\n"
+    "\t--seed N        Random seed (default: 1)\n"
+    "\t--dir PATH      Generate the repository in PATH instead of a temporary dir\n"
+    "\t--keep          Don't delete the generated repository\n",
+    program_name);
+}
+
+int
+main(int argc, char* const* argv) {
+  struct bench_options o = {
+    .packages = 100,
+    .versions = 8,
+    .fanout = 3,
+    .conflicts = 0,
+    .depth = 0,
+    .roots = 10,
+    .inserts = 0,
+    .jobs = 1,
+    .order = "name",
+    .seed = 1,
+    .dir = NULL,
+    .keep = false,
+  };
+
+  static struct option long_options[] = {
+    {"packages", required_argument, NULL, 'n'},
+    {"versions", required_argument, NULL, 'm'},
+    {"fanout", required_argument, NULL, 'f'},
+    {"conflicts", required_argument, NULL, 'c'},
+    {"depth", required_argument, NULL, 'd'},
+    {"roots", required_argument, NULL, 'r'},
+    {"inserts", required_argument, NULL, 'i'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"order", required_argument, NULL, 'o'},
+    {"seed", required_argument, NULL, 's'},
+    {"dir", required_argument, NULL, 'D'},
+    {"keep", no_argument, NULL, 'k'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "n:m:f:c:d:r:i:j:o:s:D:k", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'n': o.packages = atoi(optarg); break;
+      case 'm': o.versions = atoi(optarg); break;
+      case 'f': o.fanout = atoi(optarg); break;
+      case 'c': o.conflicts = atoi(optarg); break;
+      case 'd': o.depth = atoi(optarg); break;
+      case 'r': o.roots = atoi(optarg); break;
+      case 'i': o.inserts = atoi(optarg); break;
+      case 'j': {
+        char* end;
+        unsigned long jobs = strtoul(optarg, &end, 10);
+        if (*optarg == '\0' || *end != '\0' || *optarg == '-' || jobs < 1 || jobs > FATSO_MAX_RESOLVE_JOBS) {
+          fprintf(stderr, "Invalid number of jobs: %s (expected 1 to %d)\n", optarg, FATSO_MAX_RESOLVE_JOBS);
+          return 1;
+        }
+        o.jobs = jobs;
+        break;
+      }
+      case 'o': o.order = optarg; break;
+      case 's': o.seed = strtoull(optarg, NULL, 10); break;
+      case 'D': o.dir = optarg; break;
+      case 'k': o.keep = true; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (o.seed == 0) o.seed = 1;
+  if (o.depth > o.packages) o.depth = o.packages;
+
+  if (o.inserts) {
+    bench_inserts(&o);
+    return 0;
+  }
+
+  char tmpdir[] = "/tmp/fatso-bench-XXXXXX";
+  if (o.dir == NULL) {
+    if (mkdtemp(tmpdir) == NULL) {
+      perror("mkdtemp");
+      return 1;
+    }
+    o.dir = tmpdir;
+  }
+
+  double t0 = now_ms();
+  int r = generate_repository(&o);
+  if (r != 0) return r;
+  double generate_ms = now_ms() - t0;
+
+  struct fatso f;
+  fatso_init(&f, argv[0]);
+  fatso_set_home_directory(&f, o.dir);
+  f.resolve_jobs = o.jobs;
+  f.resolve_heuristic = fatso_decision_heuristic_by_name(o.order);
+  if (f.resolve_heuristic == NULL) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Load every package up front, so resolution is timed without parsing.
+  char name[64];
+  size_t num_versions_loaded = 0;
+  t0 = now_ms();
+  for (unsigned int i = 0; i < o.packages; ++i) {
+    package_name(name, sizeof(name), i, &o);
+    struct fatso_package* versions;
+    ssize_t n = fatso_repository_find_package_versions(&f, name, &versions);
+    if (n > 0) num_versions_loaded += n;
+  }
+  double load_ms = now_ms() - t0;
+
+  struct fatso_package root;
+  init_root_package(&root, &o);
+
+  enum fatso_dependency_graph_resolution_status status;
+  fatso_resolve_stats_reset(true);
+  t0 = now_ms();
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  double resolve_ms = now_ms() - t0;
+
+  struct fatso_package** install_order = NULL;
+  size_t install_order_size = 0;
+  double toposort_ms = 0;
+  if (status == FATSO_DEPENDENCY_GRAPH_SUCCESS) {
+    t0 = now_ms();
+    fatso_dependency_graph_topological_sort(graph, &f, &install_order, &install_order_size, NULL);
+    toposort_ms = now_ms() - t0;
+  }
+
+  printf("{\"packages\": %u, \"versions\": %u, \"fanout\": %u, \"conflicts\": %u, \"depth\": %u, \"roots\": %u, \"jobs\": %u, \"order\": \"%s\", \"seed\": %llu, "
+         "\"versions_loaded\": %zu, \"status\": \"%s\", \"installed\": %zu, \"candidates\": %zu, \"backtracks\": %zu, \"backjumps\": %zu, "
+         "\"generate_ms\": %.3f, \"load_ms\": %.3f, \"resolve_ms\": %.3f, \"toposort_ms\": %.3f, \"peak_rss_kb\": %ld}\n",
+    o.packages, o.versions, o.fanout, o.conflicts, o.depth, o.roots, o.jobs, o.order, (unsigned long long)o.seed,
+    num_versions_loaded, status_to_string(status), install_order_size, g_fatso_stats.candidates, g_fatso_stats.backtracks, g_fatso_stats.backjumps,
+    generate_ms, load_ms, resolve_ms, toposort_ms, peak_rss_kb());
+
+  fatso_free(install_order);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&root);
+
+  if (!o.keep) {
+    nftw(o.dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  fatso_destroy(&f);
+  return 0;
+}
@@ -36,8 +36,11 @@
   X(30, fatso_system_with_callbacks) \
   X(31, fatso_system_with_capture) \
   X(32, fatso_unload_project) \
-  X(33, fatso_upgrade)
-#define NUM_OVERRIDES 34
+  X(33, fatso_upgrade) \
+  X(34, fatso_dependency_graph_copy) \
+  X(35, fatso_dependency_graph_for_package) \
+  X(36, fatso_sync_packages)
+#define NUM_OVERRIDES 37
 
 struct function_override {
   const char* symbol;
@@ -1,4 +1,6 @@
 #include <dlfcn.h>
+#include <glob.h>
+#include <pthread.h>
 
 #include "test.h"
 #include "../internal.h"
@@ -29,15 +31,21 @@ static void test_interceptor() {
   ASSERT(stub_fatso_alloc_called == false);
 }
 
+static bool
+version_component_is(const struct fatso_version* ver, size_t i, const char* expected) {
+  const struct fatso_version_component* c = &ver->components.data[i];
+  return c->length == strlen(expected) && strncmp(ver->string + c->offset, expected, c->length) == 0;
+}
+
 static void test_fatso_version_from_string() {
   void* ptr = fatso_alloc(120);
   struct fatso_version ver;
   fatso_version_from_string(&ver, "0.1.2a");
   ASSERT(ver.components.size == 4);
-  ASSERT(strcmp(ver.components.data[0], "0") == 0);
-  ASSERT(strcmp(ver.components.data[1], "1") == 0);
-  ASSERT(strcmp(ver.components.data[2], "2") == 0);
-  ASSERT(strcmp(ver.components.data[3], "a") == 0);
+  ASSERT(version_component_is(&ver, 0, "0"));
+  ASSERT(version_component_is(&ver, 1, "1"));
+  ASSERT(version_component_is(&ver, 2, "2"));
+  ASSERT(version_component_is(&ver, 3, "a"));
   fatso_version_destroy(&ver);
 
   fatso_version_from_string(&ver, "a.2b");
@@ -74,6 +82,16 @@ static void test_fatso_version_compare() {
     {"0.10", "0.1", 1},
     {"1.a.0", "1.aa.0", -1},
     {"1.2", "2", -1},
+    {"1.02", "1.2", 0},
+    {"1.9", "1.10", -1},
+    {"1.beta", "1.99999", 1},
+    {"1.alphabet", "1.alphabetical", -1},
+    {"1.alphabetz", "1.alphabeta", 1},
+    {"1.abcdefg", "1.abcdefgh", -1},
+    {"1.2.3.4.5.6.7.8.9", "1.2.3.4.5.6.7.8.10", -1},
+    {"1.2.3.4.5.6.7.8.9", "1.2.3.4.5.6.7.8.9", 0},
+    {"1.2.3.4.5.6.7.8.9.1", "1.2.3.4.5.6.7.8.9", 1},
+    {"1.2.3.4.5.6.7.8", "1.2.3.4.5.6.7.8.0", -1},
     {NULL, NULL, 0}
   };
 
@@ -229,6 +247,1474 @@ test_fatso_version_matches_constraint() {
   }
 }
 
+static void
+init_test_package(struct fatso_package* p, const char* name, const char* version) {
+  fatso_package_init(p);
+  p->name = strdup(name);
+  fatso_version_from_string(&p->version, version);
+}
+
+static void
+init_test_dependency(struct fatso_dependency* dep, const char* name, const char* constraint) {
+  struct fatso_constraint c = {{0}};
+  fatso_constraint_from_string(&c, constraint);
+  fatso_dependency_init(dep, name, &c, 1);
+  fatso_constraint_destroy(&c);
+}
+
+static void
+test_fatso_version_range() {
+  struct range_test_case {
+    const char* constraints[3];
+    const char* version;
+    bool match_expectation;
+  };
+
+  static const struct range_test_case cases[] = {
+    {{">= 1.0", "< 2.0"}, "1.5", true},
+    {{">= 1.0", "< 2.0"}, "2.0", false},
+    {{"< 2.0", "<= 1.5", "< 3"}, "1.5", true},
+    {{"> 1.0", "> 1.2", ">= 1.1"}, "1.2", false},
+    {{"*", "< 1"}, "2", false},
+    {{"~> 1.2.0", ">= 1.2.5"}, "1.2.7", true},
+    {{"~> 1.2.0", ">= 1.2.5"}, "1.2.1", false},
+    {{"~> 1.2.0", ">= 1.2.5"}, "1.3", false},
+    {{"~> 1.2", "~> 1.2.4"}, "1.2.9", true},
+    {{"~> 1.2", "~> 1.2.4"}, "1.3.0", false},
+    {{"~> 1", "= 4.0"}, "4.0", true},
+    {{NULL}, NULL, 0}
+  };
+
+  for (const struct range_test_case* p = cases; p->version; ++p) {
+    struct fatso_version_range range;
+    fatso_version_range_init(&range);
+    for (size_t i = 0; i < 3 && p->constraints[i]; ++i) {
+      struct fatso_constraint c = {{0}};
+      fatso_constraint_from_string(&c, p->constraints[i]);
+      ASSERT(fatso_version_range_intersect(&range, &c));
+      fatso_constraint_destroy(&c);
+    }
+    struct fatso_version ver;
+    fatso_version_from_string(&ver, p->version);
+    ASSERT_FMT(fatso_version_range_contains(&range, &ver) == p->match_expectation, "Expected '%s' %s match '%s, %s'.", p->version, p->match_expectation ? "to" : "to not", p->constraints[0], p->constraints[1]);
+    fatso_version_destroy(&ver);
+    fatso_version_range_destroy(&range);
+  }
+
+  static const char* empty_cases[][2] = {
+    {">= 2", "< 1.5"},
+    {"= 1.2", "> 1.2"},
+    {"< 1.2", "= 1.2"},
+    {"~> 1.2.0", "~> 1.3.0"},
+    {"~> 1.2.0", ">= 1.3"},
+    {NULL, NULL},
+  };
+
+  for (size_t i = 0; empty_cases[i][0]; ++i) {
+    struct fatso_dependency dep;
+    init_test_dependency(&dep, "range-test", empty_cases[i][0]);
+    struct fatso_constraint c = {{0}};
+    fatso_constraint_from_string(&c, empty_cases[i][1]);
+    ASSERT_FMT(!fatso_dependency_add_constraint(&dep, &c), "Expected '%s, %s' to be unsatisfiable.", empty_cases[i][0], empty_cases[i][1]);
+    fatso_constraint_destroy(&c);
+    fatso_dependency_destroy(&dep);
+  }
+
+  // Repeated constraints are only kept once.
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, "range-test", ">= 1.0");
+  struct fatso_constraint c = {{0}};
+  fatso_constraint_from_string(&c, ">= 1.0");
+  for (int i = 0; i < 10; ++i) {
+    ASSERT(fatso_dependency_add_constraint(&dep, &c));
+  }
+  ASSERT(dep.constraints.size == 1);
+  fatso_constraint_destroy(&c);
+  fatso_dependency_destroy(&dep);
+}
+
+static void
+test_fatso_version_columns() {
+  // Enough versions to span several mask words, of different lengths.
+  static const char* extra_versions[] = {"1", "1.2rc1", "1.2.beta", "2", "2.0.0.1", "4.0", "10"};
+  size_t num_extra = sizeof(extra_versions) / sizeof(extra_versions[0]);
+  size_t num_versions = 150 + num_extra;
+  struct fatso_version* versions = fatso_calloc(num_versions, sizeof(struct fatso_version));
+  const struct fatso_version** pointers = fatso_calloc(num_versions, sizeof(struct fatso_version*));
+  for (size_t i = 0; i < num_versions; ++i) {
+    char buffer[32];
+    if (i < 150) {
+      snprintf(buffer, sizeof(buffer), "%zu.%zu.%zu", i / 50, i / 10 % 5, i % 10);
+    } else {
+      snprintf(buffer, sizeof(buffer), "%s", extra_versions[i - 150]);
+    }
+    fatso_version_from_string(&versions[i], buffer);
+    pointers[i] = &versions[i];
+  }
+  struct fatso_version_columns columns;
+  fatso_version_columns_init(&columns, pointers, num_versions);
+  ASSERT(columns.keys_suffice);
+
+  static const char* constraints[][2] = {
+    {">= 1.0", "< 2.0"},
+    {"> 1.2", "<= 2.0.0"},
+    {"~> 1.2.0", NULL},
+    {"~> 2.0", NULL},
+    {"= 1.2", NULL},
+    {">= 1.2.beta", NULL},
+    {"> 2", "< 1"},
+    {NULL, NULL},
+  };
+
+  uint64_t words[3];
+  for (size_t i = 0; constraints[i][0]; ++i) {
+    struct fatso_version_range range;
+    fatso_version_range_init(&range);
+    for (size_t j = 0; j < 2 && constraints[i][j]; ++j) {
+      struct fatso_constraint c = {{0}};
+      fatso_constraint_from_string(&c, constraints[i][j]);
+      fatso_version_range_intersect(&range, &c);
+      fatso_constraint_destroy(&c);
+    }
+    ASSERT(fatso_version_range_match_columns(&range, &columns, words));
+    for (size_t v = 0; v < num_versions; ++v) {
+      bool matched = (words[v / 64] >> (v % 64)) & 1;
+      ASSERT_FMT(matched == fatso_version_range_contains(&range, &versions[v]), "'%s' against '%s': got %d", fatso_version_string(&versions[v]), constraints[i][0], matched);
+    }
+    fatso_version_range_destroy(&range);
+  }
+
+  // Components too long for their keys can't be matched by key.
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, "columns-test", ">= 1.0.alphabetical");
+  ASSERT(!fatso_version_range_match_columns(&dep.range, &columns, words));
+  fatso_dependency_destroy(&dep);
+
+  // ...and neither can versions with more components than keys.
+  init_test_dependency(&dep, "columns-test", "< 1.2.3.4.5.6.7.8.10");
+  ASSERT(!fatso_version_range_match_columns(&dep.range, &columns, words));
+  fatso_dependency_destroy(&dep);
+
+  fatso_version_columns_destroy(&columns);
+  for (size_t i = 0; i < num_versions; ++i) {
+    fatso_version_destroy(&versions[i]);
+  }
+  fatso_free(pointers);
+  fatso_free(versions);
+}
+
+static void
+test_fatso_intern() {
+  char name[] = "intern-test";
+  unsigned int id = fatso_intern(name);
+  ASSERT(id != 0);
+  ASSERT(fatso_intern("intern-test") == id);
+  ASSERT(fatso_intern("intern-test-2") != id);
+  ASSERT(strcmp(fatso_interned_name(id), "intern-test") == 0);
+  ASSERT(fatso_interned_name(id) != name);
+  ASSERT(fatso_interned_name(0) == NULL);
+  ASSERT(fatso_interned_name_limit() > id);
+
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, name, ">= 1.0");
+  ASSERT(dep.name_id == id);
+  ASSERT(dep.name == fatso_interned_name(id));
+  fatso_dependency_destroy(&dep);
+}
+
+static void
+test_fatso_repository_cursor() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, "backjump-m1", ">= 1.0");
+  struct fatso_constraint c = {{0}};
+  fatso_constraint_from_string(&c, "< 3.0");
+  fatso_dependency_add_constraint(&dep, &c);
+  fatso_constraint_destroy(&c);
+
+  // Newest first, and only the ones that match:
+  struct fatso_repository_cursor cursor;
+  ASSERT(fatso_repository_cursor_begin(&f, &dep, &cursor) == 3);
+  struct fatso_package* p = fatso_repository_cursor_next(&cursor);
+  ASSERT(p && strcmp(fatso_version_string(&p->version), "2.0") == 0);
+  struct fatso_package* older = fatso_repository_cursor_next(&cursor);
+  ASSERT(older && strcmp(fatso_version_string(&older->version), "1.0") == 0);
+  ASSERT(fatso_repository_cursor_next(&cursor) == NULL);
+  fatso_repository_cursor_destroy(&cursor);
+
+  // Versions can be taken out before they come up:
+  fatso_repository_cursor_begin(&f, &dep, &cursor);
+  ASSERT(fatso_repository_cursor_remove(&cursor, p));
+  ASSERT(!fatso_repository_cursor_remove(&cursor, p));
+  ASSERT(fatso_repository_cursor_next(&cursor) == older);
+  ASSERT(fatso_repository_cursor_next(&cursor) == NULL);
+  fatso_repository_cursor_destroy(&cursor);
+
+  // The one-at-a-time lookup agrees:
+  struct fatso_package* found = NULL;
+  ASSERT(fatso_repository_find_package_matching_dependency(&f, &dep, NULL, &found) == FATSO_PACKAGE_OK && found == p);
+  ASSERT(fatso_repository_find_package_matching_dependency(&f, &dep, &p->version, &found) == FATSO_PACKAGE_OK && found == older);
+  ASSERT(fatso_repository_find_package_matching_dependency(&f, &dep, &older->version, &found) == FATSO_PACKAGE_NO_MATCHING_VERSION);
+  fatso_dependency_destroy(&dep);
+
+  init_test_dependency(&dep, "no-such-package", ">= 1.0");
+  ASSERT(fatso_repository_cursor_begin(&f, &dep, &cursor) == -1);
+  ASSERT(fatso_repository_cursor_next(&cursor) == NULL);
+  fatso_repository_cursor_destroy(&cursor);
+  ASSERT(fatso_repository_find_package_matching_dependency(&f, &dep, NULL, &found) == FATSO_PACKAGE_UNKNOWN);
+  fatso_dependency_destroy(&dep);
+
+  fatso_destroy(&f);
+}
+
+static size_t
+number_of_allocations() {
+  return fatso_interceptor_number_of_calls("fatso_alloc")
+       + fatso_interceptor_number_of_calls("fatso_calloc")
+       + fatso_interceptor_number_of_calls("fatso_reallocf");
+}
+
+static void
+test_fatso_dependency_graph_copy() {
+  static const size_t num_deps = 50;
+  struct fatso_package root;
+  struct fatso_package pinned;
+  init_test_package(&root, "root", "1.0");
+  init_test_package(&pinned, "dep-0", "1.0");
+
+  root.base_configuration.dependencies.size = num_deps;
+  root.base_configuration.dependencies.data = fatso_calloc(num_deps, sizeof(struct fatso_dependency));
+
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_new();
+  fatso_dependency_graph_add_closed_set(graph, &root);
+  for (size_t i = 0; i < num_deps; ++i) {
+    char* name;
+    asprintf(&name, "dep-%zu", i);
+    init_test_dependency(&root.base_configuration.dependencies.data[i], name, ">= 1.0");
+    fatso_dependency_graph_add_open_set(graph, &root.base_configuration.dependencies.data[i], &root);
+    free(name);
+  }
+
+  // Copying shares everything, so its cost must not depend on the size of the graph:
+  size_t allocations_before = number_of_allocations();
+  struct fatso_dependency_graph* copy = fatso_dependency_graph_copy(graph);
+  size_t allocations = number_of_allocations() - allocations_before;
+  ASSERT_FMT(allocations <= 2, "Copying a graph with %zu dependencies made %zu allocations.", num_deps, allocations);
+
+  // Writes to the copy must not be visible in the original:
+  struct fatso_dependency conflicting;
+  init_test_dependency(&conflicting, "dep-0", ">= 2.0");
+  fatso_dependency_graph_add_closed_set(copy, &pinned);
+  ASSERT(fatso_dependency_graph_add_open_set(copy, &conflicting, &root) != 0);
+  ASSERT(fatso_dependency_graph_add_open_set(graph, &conflicting, &root) == 0);
+
+  fatso_conflicts_t conflicts = {0};
+  fatso_dependency_graph_get_conflicts(graph, &conflicts);
+  ASSERT(conflicts.size == 0);
+  fatso_dependency_graph_get_conflicts(copy, &conflicts);
+  ASSERT(conflicts.size == 1);
+
+  fatso_free(conflicts.data);
+  fatso_dependency_graph_free(copy);
+  fatso_dependency_graph_free(graph);
+  fatso_dependency_destroy(&conflicting);
+  fatso_package_destroy(&pinned);
+  fatso_package_destroy(&root);
+}
+
+static struct fatso_package*
+find_package_in_list(struct fatso_package** list, size_t size, const char* name) {
+  for (size_t i = 0; i < size; ++i) {
+    if (strcmp(list[i]->name, name) == 0) {
+      return list[i];
+    }
+  }
+  return NULL;
+}
+
+static void
+test_fatso_dependency_graph_backjumping() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  // backjump-z 2.0 needs backjump-b, which needs a version of backjump-a that
+  // backjump-z 2.0 rules out, but that is only discovered after the three
+  // unrelated backjump-m packages have been pinned.
+  static const char* dependencies[] = {"backjump-z", "backjump-m1", "backjump-m2", "backjump-m3"};
+  static const size_t num_dependencies = sizeof(dependencies) / sizeof(dependencies[0]);
+  struct fatso_package root;
+  init_test_package(&root, "root", "1.0");
+  root.base_configuration.dependencies.size = num_dependencies;
+  root.base_configuration.dependencies.data = fatso_calloc(num_dependencies, sizeof(struct fatso_dependency));
+  for (size_t i = 0; i < num_dependencies; ++i) {
+    init_test_dependency(&root.base_configuration.dependencies.data[i], dependencies[i], ">= 1.0");
+  }
+
+  size_t copies_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy");
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  size_t copies = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy") - copies_before;
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+
+  struct fatso_package** list = NULL;
+  size_t size = 0;
+  fatso_dependency_graph_topological_sort(graph, &f, &list, &size, NULL);
+  ASSERT(size == num_dependencies + 1);
+  struct fatso_package* z = find_package_in_list(list, size, "backjump-z");
+  ASSERT(z != NULL);
+  ASSERT(strcmp(fatso_version_string(&z->version), "1.0") == 0);
+
+  // Chronological backtracking retries all 27 combinations of the backjump-m
+  // packages before it gets back to backjump-z.
+  ASSERT_FMT(copies <= 10, "Tried %zu candidates.", copies);
+  fatso_free(list);
+  fatso_dependency_graph_free(graph);
+
+  // Deciding the most constrained dependency first pins backjump-b, which has a
+  // single version, right after backjump-z, so there's nothing to jump over.
+  f.resolve_heuristic = &fatso_heuristic_most_constrained;
+  fatso_resolve_stats_reset(true);
+  copies_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy");
+  graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  copies = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy") - copies_before;
+  g_fatso_collect_stats = false;
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  ASSERT(g_fatso_stats.backjumps == 0);
+  ASSERT_FMT(copies <= 7, "Tried %zu candidates.", copies);
+  list = NULL;
+  size = 0;
+  fatso_dependency_graph_topological_sort(graph, &f, &list, &size, NULL);
+  z = find_package_in_list(list, size, "backjump-z");
+  ASSERT(z != NULL);
+  ASSERT(strcmp(fatso_version_string(&z->version), "1.0") == 0);
+
+  fatso_free(list);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&root);
+  fatso_destroy(&f);
+}
+
+static void
+init_test_root(struct fatso_package* root, const char** dependencies, size_t num_dependencies) {
+  init_test_package(root, "root", "1.0");
+  root->base_configuration.dependencies.size = num_dependencies;
+  root->base_configuration.dependencies.data = fatso_calloc(num_dependencies, sizeof(struct fatso_dependency));
+  for (size_t i = 0; i < num_dependencies; ++i) {
+    init_test_dependency(&root->base_configuration.dependencies.data[i], dependencies[i], ">= 1.0");
+  }
+}
+
+static void
+test_fatso_dependency_graph_parallel() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  // unknown-dep 2.0 depends on a package that doesn't exist, so 1.0 is used.
+  static const char* dependencies[] = {"backjump-z", "backjump-m1", "unknown-dep", "backjump-m2", "backjump-m3"};
+  static const size_t num_dependencies = sizeof(dependencies) / sizeof(dependencies[0]);
+
+  struct fatso_package root;
+  init_test_root(&root, dependencies, num_dependencies);
+
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* sequential = fatso_dependency_graph_for_package(&f, &root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  struct fatso_package** expected = NULL;
+  size_t expected_size = 0;
+  fatso_dependency_graph_topological_sort(sequential, &f, &expected, &expected_size, NULL);
+  struct fatso_package* unknown_dep = find_package_in_list(expected, expected_size, "unknown-dep");
+  ASSERT(unknown_dep != NULL);
+  ASSERT(strcmp(fatso_version_string(&unknown_dep->version), "1.0") == 0);
+
+  for (unsigned int jobs = 2; jobs <= 8; jobs *= 2) {
+    f.resolve_jobs = jobs;
+    struct fatso_dependency_graph* parallel = fatso_dependency_graph_for_package(&f, &root, &status);
+    ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+    struct fatso_package** list = NULL;
+    size_t size = 0;
+    fatso_dependency_graph_topological_sort(parallel, &f, &list, &size, NULL);
+    ASSERT(size == expected_size);
+    ASSERT(memcmp(list, expected, size * sizeof(*list)) == 0);
+    fatso_free(list);
+    fatso_dependency_graph_free(parallel);
+  }
+
+  // Failures are reported the same way in both modes.
+  static const char* missing[] = {"backjump-m1", "no-such-package"};
+  struct fatso_package missing_root;
+  init_test_root(&missing_root, missing, 2);
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &missing_root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_UNKNOWN);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&missing_root);
+
+  fatso_free(expected);
+  fatso_dependency_graph_free(sequential);
+  fatso_package_destroy(&root);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_dependency_graph_unsatisfiable() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  // early-z 2.0 needs a version of backjump-a that doesn't exist, which is
+  // found out when it's pinned, before any of the backjump-m packages are.
+  static const char* dependencies[] = {"early-z", "backjump-m1", "backjump-m2", "backjump-m3"};
+  struct fatso_package root;
+  init_test_root(&root, dependencies, 4);
+
+  fatso_resolve_stats_reset(true);
+  size_t copies_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy");
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  size_t copies = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy") - copies_before;
+  g_fatso_collect_stats = false;
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  ASSERT(g_fatso_stats.unsatisfiable == 1);
+  ASSERT(g_fatso_stats.backjumps == 0);
+  ASSERT_FMT(copies <= 5, "Tried %zu candidates.", copies);
+
+  struct fatso_package** list = NULL;
+  size_t size = 0;
+  fatso_dependency_graph_topological_sort(graph, &f, &list, &size, NULL);
+  struct fatso_package* z = find_package_in_list(list, size, "early-z");
+  ASSERT(z != NULL);
+  ASSERT(strcmp(fatso_version_string(&z->version), "1.0") == 0);
+
+  fatso_free(list);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&root);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_dependency_graph_budget() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  // Resolving this takes 10 candidates (see test_fatso_dependency_graph_backjumping).
+  // After the fifth, backjump-b has run out of versions because of backjump-z 2.0.
+  static const char* dependencies[] = {"backjump-z", "backjump-m1", "backjump-m2", "backjump-m3"};
+  struct fatso_package root;
+  init_test_root(&root, dependencies, 4);
+
+  for (unsigned int jobs = 1; jobs <= 2; ++jobs) {
+    f.resolve_jobs = jobs;
+    f.resolve_max_candidates = 5;
+    fatso_resolve_stats_reset(true);
+    enum fatso_dependency_graph_resolution_status status;
+    struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+    g_fatso_collect_stats = false;
+    ASSERT(status == FATSO_DEPENDENCY_GRAPH_BUDGET_EXCEEDED);
+    ASSERT(g_fatso_stats.candidates <= 5 + jobs - 1);
+
+    fatso_conflicts_t conflicts = {0};
+    fatso_dependency_graph_get_conflicts(graph, &conflicts);
+    ASSERT(conflicts.size == 1);
+    ASSERT(strcmp(conflicts.data[0].dependency->name, "backjump-b") == 0);
+    ASSERT(strcmp(conflicts.data[0].package->name, "backjump-z") == 0);
+    ASSERT(strcmp(fatso_version_string(&conflicts.data[0].package->version), "2.0") == 0);
+    fatso_free(conflicts.data);
+    fatso_dependency_graph_free(graph);
+  }
+
+  // Running out of time before anything conflicts still gives up.
+  f.resolve_jobs = 1;
+  f.resolve_max_candidates = 0;
+  f.resolve_timeout = 1e-9;
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_BUDGET_EXCEEDED);
+  fatso_dependency_graph_free(graph);
+
+  // A budget that's big enough doesn't change anything.
+  f.resolve_timeout = 60;
+  f.resolve_max_candidates = 100;
+  graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  fatso_dependency_graph_free(graph);
+
+  fatso_package_destroy(&root);
+  fatso_destroy(&f);
+}
+
+static char* g_last_log_message = NULL;
+
+static void
+capture_log(struct fatso* f, int level, const char* message, size_t length) {
+  free(g_last_log_message);
+  g_last_log_message = strndup(message, length);
+}
+
+static const struct fatso_logger g_capturing_logger = {
+  .log = capture_log,
+};
+
+static void
+add_test_dependency(struct fatso_package* p, const char* name) {
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, name, ">= 1.0");
+  fatso_push_back_v(&p->base_configuration.dependencies, &dep);
+}
+
+static void
+test_fatso_sort_install_levels() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_logger(&f, &g_capturing_logger);
+
+  struct fatso_package a, b, c, d, e;
+  init_test_package(&a, "levels-a", "1.0");
+  init_test_package(&b, "levels-b", "1.0");
+  init_test_package(&c, "levels-c", "1.0");
+  init_test_package(&d, "levels-d", "1.0");
+  init_test_package(&e, "levels-e", "1.0");
+  add_test_dependency(&b, "levels-a");
+  add_test_dependency(&c, "levels-a");
+  add_test_dependency(&d, "levels-c");
+  add_test_dependency(&d, "levels-b");
+  add_test_dependency(&d, "levels-a");
+  add_test_dependency(&d, "not-in-the-list");
+
+  struct fatso_package* packages[] = {&d, &c, &b, &e, &a};
+  fatso_install_levels_t levels = {0};
+  ASSERT(fatso_sort_install_levels(&f, packages, 5, &levels) == 0);
+  ASSERT(levels.size == 3);
+  ASSERT(levels.data[0] == 0 && levels.data[1] == 2 && levels.data[2] == 4);
+  ASSERT(packages[0] == &a && packages[1] == &e);
+  ASSERT(packages[2] == &b && packages[3] == &c);
+  ASSERT(packages[4] == &d);
+
+  // levels-a -> levels-d -> levels-c -> levels-a
+  add_test_dependency(&a, "levels-d");
+  levels.size = 0;
+  ASSERT(fatso_sort_install_levels(&f, packages, 5, &levels) != 0);
+  ASSERT(levels.size == 0);
+  ASSERT(g_last_log_message != NULL);
+  ASSERT_FMT(strstr(g_last_log_message, "levels-a 1.0 -> levels-d 1.0 -> levels-c 1.0 -> levels-a 1.0") != NULL, "%s", g_last_log_message);
+
+  free(g_last_log_message);
+  g_last_log_message = NULL;
+  fatso_free(levels.data);
+  fatso_package_destroy(&a);
+  fatso_package_destroy(&b);
+  fatso_package_destroy(&c);
+  fatso_package_destroy(&d);
+  fatso_package_destroy(&e);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_resolve_stats() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  static const char* dependencies[] = {"backjump-z", "backjump-m1", "backjump-m2", "backjump-m3"};
+  struct fatso_package root;
+  init_test_root(&root, dependencies, 4);
+
+  fatso_resolve_stats_reset(true);
+  size_t copies_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy");
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  size_t copies = fatso_interceptor_number_of_calls("fatso_dependency_graph_copy") - copies_before;
+  g_fatso_collect_stats = false;
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  ASSERT(g_fatso_stats.graph_copies == copies);
+  ASSERT(g_fatso_stats.candidates > 0);
+  ASSERT(g_fatso_stats.backjumps > 0);
+  ASSERT(g_fatso_stats.nogoods > 0);
+  ASSERT(g_fatso_stats.unsatisfiable > 0);
+  ASSERT(g_fatso_stats.bytes_requested > 0);
+
+  char* json;
+  size_t json_len;
+  g_fatso_stats.source = "resolver";
+  FILE* fp = open_memstream(&json, &json_len);
+  fatso_resolve_stats_print(fp, true);
+  fclose(fp);
+  char* expected;
+  asprintf(&expected, "\"graph_copies\": %zu,", copies);
+  static const char prefix[] = "{\"source\": \"resolver\", ";
+  ASSERT(strncmp(json, prefix, sizeof(prefix) - 1) == 0);
+  ASSERT(strstr(json, expected) != NULL);
+  free(expected);
+  free(json);
+
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&root);
+  fatso_destroy(&f);
+}
+
+static void
+write_test_file(const char* dir, const char* name, const char* contents) {
+  char* path;
+  asprintf(&path, "%s/%s", dir, name);
+  FILE* fp = fopen(path, "w");
+  fputs(contents, fp);
+  fclose(fp);
+  free(path);
+}
+
+static void
+remove_test_file(const char* dir, const char* name) {
+  char* path;
+  asprintf(&path, "%s/%s", dir, name);
+  unlink(path);
+  free(path);
+}
+
+static void
+test_fatso_lockfile() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  char dir[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(dir) != NULL);
+  fatso_set_project_directory(&f, dir);
+  write_test_file(dir, "fatso.yml",
+    "project: lockfile-test\n"
+    "version: 1.0\n"
+    "dependencies:\n"
+    "- [backjump-z, '>= 1.0']\n"
+    "- [unknown-dep, '>= 1.0']\n");
+
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_load_dependency_graph(&f) != 0);
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  size_t size = f.project->install_order.size;
+  struct fatso_package** expected = fatso_calloc(size, sizeof(struct fatso_package*));
+  memcpy(expected, f.project->install_order.data, size * sizeof(struct fatso_package*));
+  ASSERT(size == 3);
+  fatso_unload_project(&f);
+
+  // The lock file is used instead of resolving again.
+  ASSERT(fatso_load_project(&f) == 0);
+  size_t resolves_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package");
+  ASSERT(fatso_load_or_generate_dependency_graph(&f) == 0);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package") == resolves_before);
+  ASSERT(f.project->install_order.size == size);
+  ASSERT(memcmp(f.project->install_order.data, expected, size * sizeof(struct fatso_package*)) == 0);
+  fatso_unload_project(&f);
+
+  // Changing fatso.yml makes the lock file stale.
+  write_test_file(dir, "fatso.yml",
+    "project: lockfile-test\n"
+    "version: 1.0\n"
+    "dependencies:\n"
+    "- [backjump-z, '>= 2.0']\n");
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_load_dependency_graph(&f) != 0);
+  fatso_unload_project(&f);
+
+  fatso_free(expected);
+  remove_test_file(dir, "fatso.lock.yml");
+  remove_test_file(dir, "fatso.yml");
+  rmdir(dir);
+  fatso_destroy(&f);
+}
+
+static const char*
+installed_version(struct fatso* f, const char* name) {
+  for (size_t i = 0; i < f->project->install_order.size; ++i) {
+    struct fatso_package* p = f->project->install_order.data[i];
+    if (strcmp(p->name, name) == 0)
+      return fatso_version_string(&p->version);
+  }
+  return NULL;
+}
+
+static void
+test_fatso_preferred_versions() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+
+  char dir[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(dir) != NULL);
+  fatso_set_project_directory(&f, dir);
+  write_test_file(dir, "fatso.yml",
+    "project: preferred-test\n"
+    "version: 1.0\n"
+    "dependencies:\n"
+    "- [backjump-m1, '< 2.0']\n"
+    "- [faker, '< 0.2']\n");
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_load_or_generate_dependency_graph(&f) == 0);
+  ASSERT(strcmp(installed_version(&f, "backjump-m1"), "1.0") == 0);
+  ASSERT(strcmp(installed_version(&f, "faker"), "0.1.1") == 0);
+  ASSERT(installed_version(&f, "libyaml") != NULL);
+  fatso_unload_project(&f);
+
+  // Adding a dependency keeps the versions that still fit, even though
+  // newer ones would now be allowed.
+  write_test_file(dir, "fatso.yml",
+    "project: preferred-test\n"
+    "version: 1.0\n"
+    "dependencies:\n"
+    "- [backjump-m1, '>= 1.0']\n"
+    "- [faker, '>= 0.1']\n"
+    "- [backjump-m2, '>= 1.0']\n");
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_load_or_generate_dependency_graph(&f) == 0);
+  ASSERT(strcmp(installed_version(&f, "backjump-m1"), "1.0") == 0);
+  ASSERT(strcmp(installed_version(&f, "faker"), "0.1.1") == 0);
+  ASSERT(strcmp(installed_version(&f, "backjump-m2"), "3.0") == 0);
+
+  // The same with parallel resolution:
+  f.resolve_jobs = 2;
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  ASSERT(strcmp(installed_version(&f, "backjump-m1"), "1.0") == 0);
+  ASSERT(strcmp(installed_version(&f, "faker"), "0.1.1") == 0);
+  f.resolve_jobs = 0;
+  fatso_unload_project(&f);
+
+  // Upgrading libyaml also upgrades faker, which depends on it, but nothing
+  // else.
+  ASSERT(fatso_load_project(&f) == 0);
+  const char* names[] = {"libyaml"};
+  ASSERT(fatso_upgrade_dependency_graph(&f, names, 1) == 0);
+  ASSERT(strcmp(installed_version(&f, "faker"), "0.2.0") == 0);
+  ASSERT(installed_version(&f, "libyaml") == NULL);
+  ASSERT(strcmp(installed_version(&f, "backjump-m1"), "1.0") == 0);
+  fatso_unload_project(&f);
+
+  // Upgrading everything:
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_upgrade_dependency_graph(&f, NULL, 0) == 0);
+  ASSERT(strcmp(installed_version(&f, "backjump-m1"), "3.0") == 0);
+  fatso_unload_project(&f);
+
+  remove_test_file(dir, "fatso.lock.yml");
+  remove_test_file(dir, "fatso.yml");
+  rmdir(dir);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_upgrade_does_not_sync() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  fatso_set_home_directory(&f, home);
+  fatso_set_project_directory(&f, home);
+  write_test_file(home, "fatso.yml", "project: upgrade-test\nversion: 1.0\n");
+
+  // Upgrading only looks at the packages repository as it is; fetching new
+  // versions is up to `fatso sync`.
+  size_t syncs_before = fatso_interceptor_number_of_calls("fatso_sync_packages");
+  size_t systems_before = fatso_interceptor_number_of_calls("fatso_system");
+  char* const argv[] = {"upgrade", NULL};
+  ASSERT(fatso_upgrade(&f, 1, argv) == 0);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_sync_packages") == syncs_before);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_system") == systems_before);
+
+  fatso_destroy(&f);
+  char* cmd;
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+}
+
+static size_t
+count_files(const char* pattern) {
+  glob_t g;
+  size_t n = glob(pattern, 0, NULL, &g) == 0 ? g.gl_pathc : 0;
+  globfree(&g);
+  return n;
+}
+
+static void
+test_fatso_repository_prefetch() {
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, "test");
+  fatso_set_logger(&f, &g_capturing_logger);
+
+  // Everything the package could depend on is loaded, and the packages that
+  // don't exist are collected along the way:
+  struct fatso_package root;
+  init_test_package(&root, "prefetch-root", "1.0");
+  add_test_dependency(&root, "backjump-z");
+  add_test_dependency(&root, "unknown-dep");
+  fatso_resolve_stats_reset(true);
+  fatso_name_ids_t unknown = {0};
+  fatso_repository_prefetch(&f, &root, &unknown);
+  ASSERT(unknown.size == 1);
+  ASSERT(strcmp(fatso_interned_name(unknown.data[0]), "no-such-package") == 0);
+  ASSERT(g_fatso_stats.prefetched >= 5);
+  size_t misses = g_fatso_stats.repository_misses;
+  struct fatso_package* versions;
+  ASSERT(fatso_repository_find_package_versions(&f, "backjump-b", &versions) > 0);
+  ASSERT(fatso_repository_find_package_versions(&f, "no-such-package", &versions) == -1);
+  ASSERT(g_fatso_stats.repository_misses == misses);
+  fatso_resolve_stats_reset(false);
+  fatso_free(unknown.data);
+  fatso_package_destroy(&root);
+
+  // A project that depends on packages that don't exist reports all of them:
+  char dir[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(dir) != NULL);
+  write_test_file(dir, "fatso.yml", "project: prefetch\nversion: 1.0\ndependencies:\n- [missing-b]\n- [faker]\n- [missing-a]\n");
+  fatso_set_project_directory(&f, dir);
+  ASSERT(fatso_load_project(&f) == 0);
+  size_t resolves_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package");
+  ASSERT(fatso_generate_dependency_graph(&f) != 0);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package") == resolves_before);
+  ASSERT(g_last_log_message != NULL);
+  ASSERT_FMT(strstr(g_last_log_message, "  missing-a\n  missing-b\n") != NULL, "%s", g_last_log_message);
+  fatso_unload_project(&f);
+
+  char* cmd;
+  asprintf(&cmd, "rm -rf %s", dir);
+  system(cmd);
+  free(cmd);
+  free(g_last_log_message);
+  g_last_log_message = NULL;
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_resolution_cache() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  // A home directory with a git checkout of some of the test packages:
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* cwd = getcwd(NULL, 0);
+  char* cmd;
+  asprintf(&cmd,
+    "mkdir -p %s/packages/.git/refs/heads %s/a %s/b && "
+    "for p in backjump-a backjump-z unknown-dep; do cp -R %s/test/packages/$p %s/packages/$p; done && "
+    "echo 'ref: refs/heads/master' > %s/packages/.git/HEAD && "
+    "echo 1111111111111111111111111111111111111111 > %s/packages/.git/refs/heads/master",
+    home, home, home, cwd, home, home, home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  free(cwd);
+  fatso_set_home_directory(&f, home);
+
+  // Two projects with the same dependencies:
+  char* project_a;
+  char* project_b;
+  asprintf(&project_a, "%s/a", home);
+  asprintf(&project_b, "%s/b", home);
+  static const char dependencies[] =
+    "dependencies:\n"
+    "- [backjump-z, '>= 1.0']\n"
+    "- [unknown-dep, '>= 1.0']\n";
+  char* fatso_yml;
+  asprintf(&fatso_yml, "project: a\nversion: 1.0\n%s", dependencies);
+  write_test_file(project_a, "fatso.yml", fatso_yml);
+  free(fatso_yml);
+  asprintf(&fatso_yml, "project: b\nversion: 2.0\n%s", dependencies);
+  write_test_file(project_b, "fatso.yml", fatso_yml);
+  free(fatso_yml);
+
+  fatso_set_project_directory(&f, project_a);
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  size_t size = f.project->install_order.size;
+  struct fatso_package** expected = fatso_calloc(size, sizeof(struct fatso_package*));
+  memcpy(expected, f.project->install_order.data, size * sizeof(struct fatso_package*));
+  fatso_unload_project(&f);
+
+  char* pattern;
+  asprintf(&pattern, "%s/cache/resolutions/*.yml", home);
+  ASSERT(count_files(pattern) == 1);
+
+  // The second project is resolved from the cache:
+  fatso_set_project_directory(&f, project_b);
+  ASSERT(fatso_load_project(&f) == 0);
+  size_t resolves_before = fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package");
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package") == resolves_before);
+  ASSERT(f.project->install_order.size == size);
+  ASSERT(memcmp(f.project->install_order.data, expected, size * sizeof(struct fatso_package*)) == 0);
+  fatso_unload_project(&f);
+
+  // ...until the packages repository moves on, which it's seen to do when it's opened again.
+  asprintf(&cmd, "echo 2222222222222222222222222222222222222222 > %s/packages/.git/refs/heads/master", home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  fatso_set_repository(&f, NULL);
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  ASSERT(fatso_interceptor_number_of_calls("fatso_dependency_graph_for_package") == resolves_before + 1);
+  ASSERT(count_files(pattern) == 2);
+  fatso_unload_project(&f);
+
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  free(pattern);
+  free(project_a);
+  free(project_b);
+  fatso_free(expected);
+  fatso_destroy(&f);
+}
+
+static bool
+strings_equal(const char* a, const char* b) {
+  return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static bool
+configurations_equal(const struct fatso_configuration* a, const struct fatso_configuration* b) {
+  if (!strings_equal(a->name, b->name) || a->dependencies.size != b->dependencies.size
+    || a->defines.size != b->defines.size || a->env.size != b->env.size)
+    return false;
+  for (size_t i = 0; i < a->dependencies.size; ++i) {
+    const struct fatso_dependency* da = &a->dependencies.data[i];
+    const struct fatso_dependency* db = &b->dependencies.data[i];
+    if (da->name_id != db->name_id || da->constraints.size != db->constraints.size)
+      return false;
+    for (size_t j = 0; j < da->constraints.size; ++j) {
+      char* ca = fatso_constraint_to_string(&da->constraints.data[j]);
+      char* cb = fatso_constraint_to_string(&db->constraints.data[j]);
+      bool equal = strcmp(ca, cb) == 0;
+      free(ca);
+      free(cb);
+      if (!equal)
+        return false;
+    }
+  }
+  for (size_t i = 0; i < a->defines.size; ++i) {
+    if (!strings_equal(a->defines.data[i].key, b->defines.data[i].key) || !strings_equal(a->defines.data[i].value, b->defines.data[i].value))
+      return false;
+  }
+  return true;
+}
+
+static bool
+packages_equal(const struct fatso_package* a, const struct fatso_package* b) {
+  if (!strings_equal(a->name, b->name) || a->name_id != b->name_id
+    || !strings_equal(fatso_version_string(&a->version), fatso_version_string(&b->version))
+    || !strings_equal(a->author, b->author) || !strings_equal(a->toolchain, b->toolchain)
+    || (a->source == NULL) != (b->source == NULL)
+    || a->configurations.size != b->configurations.size)
+    return false;
+  if (a->source && (a->source->vtbl != b->source->vtbl || strcmp(a->source->name, b->source->name) != 0))
+    return false;
+  if (!configurations_equal(&a->base_configuration, &b->base_configuration))
+    return false;
+  for (size_t i = 0; i < a->configurations.size; ++i) {
+    if (!configurations_equal(&a->configurations.data[i], &b->configurations.data[i]))
+      return false;
+  }
+  return true;
+}
+
+static void
+test_fatso_package_index() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* cwd = getcwd(NULL, 0);
+  char* cmd;
+  asprintf(&cmd,
+    "mkdir -p %s/packages/.git/refs/heads %s/packages/sourced %s/packages/empty && "
+    "for p in faker libyaml backjump-a; do cp -R %s/test/packages/$p %s/packages/$p; done && "
+    "echo 'ref: refs/heads/master' > %s/packages/.git/HEAD && "
+    "echo 1111111111111111111111111111111111111111 > %s/packages/.git/refs/heads/master",
+    home, home, home, cwd, home, home, home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  free(cwd);
+  fatso_set_home_directory(&f, home);
+
+  // Packages with everything the index has to keep:
+  char* sourced;
+  asprintf(&sourced, "%s/packages/sourced", home);
+  write_test_file(sourced, "1.0.yml",
+    "project: sourced\n"
+    "author: Someone\n"
+    "toolchain: make\n"
+    "source:\n"
+    "  git: git@example.com:sourced.git\n"
+    "  ref: v1.0\n"
+    "dependencies:\n"
+    "- [libyaml, '~> 0.1']\n"
+    "- [faker]\n"
+    "defines:\n"
+    "  FOO: foo\n"
+    "  BAR: ''\n"
+    "configurations:\n"
+    "- dependencies:\n"
+    "  - [backjump-a, '< 2.0']\n"
+    "  defines:\n"
+    "    BAZ: baz\n");
+  write_test_file(sourced, "2.0-beta.yml",
+    "project: sourced\n"
+    "source: http://example.com/sourced-2.0-beta.tar.gz\n");
+  free(sourced);
+
+  // An open repository is opened again, so it doesn't keep reading the old index:
+  struct fatso_repository* before = fatso_get_repository(&f);
+  ASSERT(fatso_repository_build_index(&f) == 0);
+  ASSERT(f.repository != NULL && f.repository != before);
+  char* path;
+  asprintf(&path, "%s/cache/packages.index", home);
+
+  char* revision;
+  ASSERT(fatso_repository_revision(&f, &revision) == 0);
+  ASSERT(strncmp(revision, "1111111111111111111111111111111111111111-", 41) == 0);
+  struct fatso_package_index index;
+  ASSERT(fatso_package_index_open(&index, path, revision) == 0);
+  static const char* names[] = {"backjump-a", "faker", "libyaml", "sourced"};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    struct fatso_package* parsed;
+    struct fatso_package* indexed;
+    ssize_t num_parsed = fatso_repository_parse_package_versions(&f, names[i], false, &parsed);
+    ssize_t num_indexed = fatso_package_index_load_versions(&index, names[i], false, &indexed);
+    ASSERT(num_parsed > 0);
+    ASSERT(num_indexed == num_parsed);
+    for (ssize_t j = 0; j < num_parsed; ++j) {
+      ASSERT(packages_equal(&indexed[j], &parsed[j]));
+      fatso_package_destroy(&indexed[j]);
+      fatso_package_destroy(&parsed[j]);
+    }
+    fatso_free(indexed);
+    fatso_free(parsed);
+  }
+  // Summaries leave out what the resolver doesn't need, until it's loaded:
+  struct fatso_package* packages;
+  ASSERT(fatso_package_index_load_versions(&index, "sourced", true, &packages) == 2);
+  ASSERT(packages[0].is_summary);
+  ASSERT(packages[0].source == NULL && packages[0].author == NULL);
+  ASSERT(packages[0].base_configuration.dependencies.size == 2 && packages[0].base_configuration.defines.size == 0);
+  ASSERT(packages[0].configurations.size == 1 && packages[0].configurations.data[0].dependencies.size == 1);
+  struct fatso_package package;
+  ASSERT(fatso_package_index_load_package(&index, "sourced", "1.0", &package) == 0);
+  ASSERT(!package.is_summary && package.source != NULL && package.base_configuration.defines.size == 2);
+  ASSERT(fatso_package_index_load_package(&index, "sourced", "3.0", &package) != 0);
+  fatso_package_destroy(&package);
+  fatso_package_destroy(&packages[0]);
+  fatso_package_destroy(&packages[1]);
+  fatso_free(packages);
+  ASSERT(fatso_package_index_load_versions(&index, "unknown", false, &packages) == -1);
+  ASSERT(fatso_package_index_load_versions(&index, "empty", false, &packages) == -1);
+  fatso_package_index_close(&index);
+
+  // An index for another revision is stale:
+  ASSERT(fatso_package_index_open(&index, path, "2222222222222222222222222222222222222222") != 0);
+
+  // ...and so is one from before an uncommitted edit:
+  asprintf(&sourced, "%s/packages/sourced", home);
+  write_test_file(sourced, "2.0-beta.yml",
+    "project: sourced\n"
+    "source: http://example.com/sourced-2.0-beta2.tar.gz\n");
+  free(sourced);
+  char* edited_revision;
+  fatso_set_repository(&f, NULL);
+  ASSERT(fatso_repository_revision(&f, &edited_revision) == 0);
+  ASSERT(strcmp(edited_revision, revision) != 0);
+  ASSERT(fatso_package_index_open(&index, path, edited_revision) != 0);
+  free(edited_revision);
+
+  // ...and a broken one is ignored:
+  ASSERT(truncate(path, 100) == 0);
+  ASSERT(fatso_package_index_open(&index, path, revision) != 0);
+
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  free(revision);
+  free(path);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_lazy_packages() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* cwd = getcwd(NULL, 0);
+  char* cmd;
+  asprintf(&cmd,
+    "mkdir -p %s/packages/lazy %s/project && "
+    "for p in faker libyaml; do cp -R %s/test/packages/$p %s/packages/$p; done",
+    home, home, cwd, home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  free(cwd);
+  fatso_set_home_directory(&f, home);
+
+  char* dir;
+  asprintf(&dir, "%s/packages/lazy", home);
+  write_test_file(dir, "1.0.yml",
+    "project: lazy\n"
+    "author: Someone\n"
+    "source:\n"
+    "  git: git@example.com:lazy.git\n"
+    "dependencies:\n"
+    "- [faker, '< 0.2']\n"
+    "defines:\n"
+    "  FOO: foo\n");
+  write_test_file(dir, "2.0.yml",
+    "project: lazy\n"
+    "source: http://example.com/lazy-2.0.tar.gz\n"
+    "dependencies:\n"
+    "- [libyaml, '> 1.0']\n");
+  free(dir);
+
+  // The repository only has summaries at first:
+  struct fatso_package* versions;
+  ASSERT(fatso_repository_find_package_versions(&f, "lazy", &versions) == 2);
+  ASSERT(versions[0].is_summary && versions[1].is_summary);
+  ASSERT(versions[0].source == NULL && versions[0].author == NULL && versions[0].base_configuration.defines.size == 0);
+  ASSERT(versions[0].base_configuration.dependencies.size == 1);
+
+  // Resolving loads the chosen versions in full, and leaves the dependencies where they were:
+  struct fatso_dependency* dependencies = versions[0].base_configuration.dependencies.data;
+  asprintf(&dir, "%s/project", home);
+  write_test_file(dir, "fatso.yml", "project: lazy-project\nversion: 1.0\ndependencies:\n- [lazy]\n");
+  fatso_set_project_directory(&f, dir);
+  free(dir);
+  ASSERT(fatso_load_project(&f) == 0);
+  ASSERT(fatso_generate_dependency_graph(&f) == 0);
+  ASSERT(f.project->install_order.size == 3);
+  for (size_t i = 0; i < f.project->install_order.size; ++i) {
+    ASSERT(!f.project->install_order.data[i]->is_summary);
+  }
+  ASSERT(strcmp(installed_version(&f, "lazy"), "1.0") == 0);
+  ASSERT(!versions[0].is_summary && versions[1].is_summary);
+  ASSERT(versions[0].base_configuration.dependencies.data == dependencies);
+
+  struct fatso_package* parsed;
+  ASSERT(fatso_repository_parse_package_versions(&f, "lazy", false, &parsed) == 2);
+  ASSERT(packages_equal(&versions[0], &parsed[0]));
+  ASSERT(fatso_repository_load_package(&f, &versions[1]) == 0);
+  ASSERT(packages_equal(&versions[1], &parsed[1]));
+  fatso_package_destroy(&parsed[0]);
+  fatso_package_destroy(&parsed[1]);
+  fatso_free(parsed);
+  fatso_unload_project(&f);
+
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_parse_package_versions() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* dir;
+  asprintf(&dir, "%s/packages/many", home);
+  ASSERT(fatso_mkdir_p(dir) == 0);
+  fatso_set_home_directory(&f, home);
+
+  // Enough versions to be parsed on several threads, where there are cores:
+  for (int i = 100; i > 0; --i) {
+    char name[32];
+    snprintf(name, sizeof(name), "%d.%d.yml", i / 10, i % 10);
+    write_test_file(dir, name, "project: many\n");
+  }
+  // Files with the same version are kept in the order of their names:
+  write_test_file(dir, "z.yml", "project: many\nversion: 5.5\nauthor: z\n");
+  write_test_file(dir, "a.yml", "project: many\nversion: 5.5\nauthor: a\n");
+  free(dir);
+
+  struct fatso_package* packages;
+  ASSERT(fatso_repository_parse_package_versions(&f, "many", false, &packages) == 102);
+  for (size_t i = 1; i < 102; ++i) {
+    ASSERT(fatso_version_compare(&packages[i - 1].version, &packages[i].version) <= 0);
+  }
+  ASSERT(strcmp(fatso_version_string(&packages[0].version), "0.1") == 0);
+  ASSERT(strcmp(fatso_version_string(&packages[101].version), "10.0") == 0);
+  ASSERT(strcmp(packages[54].path + strlen(packages[54].path) - 8, "/5.5.yml") == 0);
+  ASSERT(strcmp(packages[55].author, "a") == 0);
+  ASSERT(strcmp(packages[56].author, "z") == 0);
+  ASSERT(strcmp(fatso_version_string(&packages[57].version), "5.6") == 0);
+  for (size_t i = 0; i < 102; ++i) {
+    fatso_package_destroy(&packages[i]);
+  }
+  fatso_free(packages);
+
+  char* cmd;
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  fatso_destroy(&f);
+}
+
+static void
+test_fatso_package_cache() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* dir;
+  asprintf(&dir, "%s/packages/cached", home);
+  ASSERT(fatso_mkdir_p(dir) == 0);
+  fatso_set_home_directory(&f, home);
+  write_test_file(dir, "1.0.yml", "project: cached\nsource: http://example.com/cached-1.0.tar.gz\ndefines:\n  FOO: foo\n");
+  write_test_file(dir, "2.0.yml", "project: cached\ndependencies:\n- [faker]\n");
+
+  // Looking a package up the first time caches it:
+  char* key;
+  ASSERT(fatso_repository_package_cache_key(&f, "cached", &key) == 0);
+  struct fatso_package* versions;
+  ASSERT(fatso_repository_find_package_versions(&f, "cached", &versions) == 2);
+  ASSERT(versions[0].is_summary && versions[0].source == NULL);
+  char* path = fatso_repository_package_cache_path(&f, "cached");
+  struct fatso_package_index cache;
+  ASSERT(fatso_package_index_open(&cache, path, key) == 0);
+  struct fatso_package* cached;
+  ASSERT(fatso_package_index_load_versions(&cache, "cached", true, &cached) == 2);
+  ASSERT(strcmp(fatso_version_string(&cached[1].version), "2.0") == 0);
+  ASSERT(cached[1].base_configuration.dependencies.size == 1);
+  fatso_package_destroy(&cached[0]);
+  fatso_package_destroy(&cached[1]);
+  fatso_free(cached);
+  fatso_package_index_close(&cache);
+
+  // ...and the rest of a package is loaded from the cache too:
+  ASSERT(fatso_repository_load_package(&f, &versions[0]) == 0);
+  ASSERT(versions[0].source != NULL && versions[0].base_configuration.defines.size == 1);
+
+  // Changing a version file makes the cache stale:
+  write_test_file(dir, "2.0.yml", "project: cached\ndependencies:\n- [faker, '>= 0.2']\n");
+  char* new_key;
+  ASSERT(fatso_repository_package_cache_key(&f, "cached", &new_key) == 0);
+  ASSERT(strcmp(key, new_key) != 0);
+  ASSERT(fatso_package_index_open(&cache, path, new_key) != 0);
+  free(new_key);
+  free(key);
+  free(path);
+
+  // Unknown packages aren't cached:
+  ASSERT(fatso_repository_find_package_versions(&f, "not-cached", &versions) == -1);
+  ASSERT(fatso_repository_package_cache_key(&f, "not-cached", &key) != 0);
+  path = fatso_repository_package_cache_path(&f, "not-cached");
+  ASSERT(!fatso_file_exists(path));
+  free(path);
+
+  char* cmd;
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  free(dir);
+  fatso_destroy(&f);
+}
+
+static const char* const g_shared_repository_names[] = { "backjump-a", "backjump-z", "faker", "libyaml", "not-a-package" };
+#define NUM_SHARED_REPOSITORY_NAMES (sizeof(g_shared_repository_names) / sizeof(g_shared_repository_names[0]))
+
+struct shared_repository_lookups {
+  struct fatso_repository* repository;
+  struct fatso_package* versions[NUM_SHARED_REPOSITORY_NAMES];
+  ssize_t num_versions[NUM_SHARED_REPOSITORY_NAMES];
+};
+
+static void*
+look_up_shared_repository(void* userdata) {
+  struct shared_repository_lookups* lookups = userdata;
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_repository(&f, lookups->repository);
+  for (size_t i = 0; i < NUM_SHARED_REPOSITORY_NAMES; ++i) {
+    lookups->num_versions[i] = fatso_repository_find_package_versions(&f, g_shared_repository_names[i], &lookups->versions[i]);
+    if (lookups->num_versions[i] > 0) {
+      fatso_repository_load_package(&f, &lookups->versions[i][0]);
+    }
+  }
+  fatso_destroy(&f);
+  return NULL;
+}
+
+static void
+test_fatso_shared_repository() {
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* cwd = getcwd(NULL, 0);
+  char* cmd;
+  asprintf(&cmd, "mkdir -p %s/packages && for p in backjump-a backjump-z faker libyaml; do cp -R %s/test/packages/$p %s/packages/$p; done", home, cwd, home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  free(cwd);
+
+  // Several threads, each with its own `struct fatso`, look packages up in one repository:
+  struct fatso_repository* repository = fatso_repository_new(home);
+  struct shared_repository_lookups lookups[4];
+  pthread_t threads[4];
+  for (size_t i = 0; i < 4; ++i) {
+    lookups[i].repository = repository;
+    ASSERT(pthread_create(&threads[i], NULL, look_up_shared_repository, &lookups[i]) == 0);
+  }
+  for (size_t i = 0; i < 4; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // ...and all of them get the same packages, loaded once.
+  for (size_t i = 1; i < 4; ++i) {
+    for (size_t j = 0; j < NUM_SHARED_REPOSITORY_NAMES; ++j) {
+      ASSERT(lookups[i].num_versions[j] == lookups[0].num_versions[j]);
+      if (lookups[i].num_versions[j] > 0) {
+        ASSERT(lookups[i].versions[j] == lookups[0].versions[j]);
+      }
+    }
+  }
+  ASSERT(lookups[0].num_versions[0] > 0 && !lookups[0].versions[0][0].is_summary);
+  ASSERT(lookups[0].num_versions[NUM_SHARED_REPOSITORY_NAMES - 1] == -1);
+
+  // The repository outlives the `struct fatso`s it was set on, until it's released:
+  struct fatso f;
+  fatso_init(&f, "test");
+  fatso_set_home_directory(&f, home);
+  fatso_set_repository(&f, repository);
+  fatso_repository_release(repository);
+  struct fatso_package* versions;
+  ASSERT(fatso_repository_find_package_versions(&f, "faker", &versions) == lookups[0].num_versions[2]);
+  ASSERT(versions == lookups[0].versions[2]);
+
+  // Another home directory is another repository:
+  fatso_set_home_directory(&f, "test");
+  ASSERT(f.repository == NULL);
+  ASSERT(strcmp(fatso_repository_home_directory(fatso_get_repository(&f)), home) != 0);
+  fatso_destroy(&f);
+
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+}
+
+static void
+test_fatso_presolve() {
+  struct fatso f;
+  fatso_init(&f, "test");
+
+  char home[] = "/tmp/fatso-test-XXXXXX";
+  ASSERT(mkdtemp(home) != NULL);
+  char* cmd;
+  asprintf(&cmd,
+    "mkdir -p %s/packages/.git/refs/heads %s/packages/leaf %s/packages/broken %s/packages/mid %s/packages/top %s/packages/lost && "
+    "echo 'ref: refs/heads/master' > %s/packages/.git/HEAD && "
+    "echo 1111111111111111111111111111111111111111 > %s/packages/.git/refs/heads/master",
+    home, home, home, home, home, home, home, home);
+  ASSERT(system(cmd) == 0);
+  free(cmd);
+  char* dir;
+#define WRITE_PACKAGE(NAME, VERSION, CONTENTS) \
+  asprintf(&dir, "%s/packages/" NAME, home); \
+  write_test_file(dir, VERSION ".yml", "project: " NAME "\nversion: " VERSION "\n" CONTENTS); \
+  free(dir);
+  WRITE_PACKAGE("leaf", "1.0", "");
+  WRITE_PACKAGE("leaf", "2.0", "");
+  WRITE_PACKAGE("broken", "1.0", "dependencies:\n- [leaf, '>= 3.0']\n");
+  WRITE_PACKAGE("mid", "1.0", "dependencies:\n- [leaf, '>= 2.0']\n");
+  WRITE_PACKAGE("mid", "2.0", "dependencies:\n- [broken]\n");
+  WRITE_PACKAGE("top", "1.0", "dependencies:\n- [mid]\n");
+  WRITE_PACKAGE("lost", "1.0", "dependencies:\n- [nowhere]\n");
+#undef WRITE_PACKAGE
+  fatso_set_home_directory(&f, home);
+  ASSERT(fatso_repository_build_index(&f) == 0);
+
+  // Versions that depend on something that can't be installed are dead, and
+  // so are the versions that depend only on those:
+  struct fatso_package* broken;
+  struct fatso_package* mid;
+  struct fatso_package* top;
+  ASSERT(fatso_repository_find_package_versions(&f, "broken", &broken) == 1);
+  ASSERT(fatso_repository_find_package_versions(&f, "mid", &mid) == 2);
+  ASSERT(fatso_repository_find_package_versions(&f, "top", &top) == 1);
+  ASSERT(broken[0].is_dead);
+  ASSERT(!mid[0].is_dead && mid[1].is_dead);
+  ASSERT(!top[0].is_dead);
+
+  // ...and every dependency knows which live versions it's compatible with:
+  const struct fatso_dependency* top_mid = &top[0].base_configuration.dependencies.data[0];
+  ASSERT(top_mid->compatible.size == 1 && top_mid->compatible.data[0] == 1);
+  const struct fatso_dependency* mid_leaf = &mid[0].base_configuration.dependencies.data[0];
+  ASSERT(mid_leaf->compatible.size == 1 && mid_leaf->compatible.data[0] == 2);
+
+  // Looking up the newest matching version skips the dead ones too:
+  struct fatso_package* newest = NULL;
+  ASSERT(fatso_repository_find_package(&f, "mid", NULL, &newest) == FATSO_PACKAGE_OK);
+  ASSERT(newest == &mid[0]);
+  ASSERT(fatso_repository_find_package(&f, "broken", NULL, &newest) == FATSO_PACKAGE_NO_MATCHING_VERSION);
+
+  // The resolver never tries the dead versions:
+  struct fatso_package root;
+  init_test_package(&root, "root", "1.0");
+  add_test_dependency(&root, "top");
+  fatso_resolve_stats_reset(true);
+  enum fatso_dependency_graph_resolution_status status;
+  struct fatso_dependency_graph* graph = fatso_dependency_graph_for_package(&f, &root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  ASSERT_FMT(g_fatso_stats.candidates == 3, "Tried %zu candidates.", g_fatso_stats.candidates);
+  ASSERT(g_fatso_stats.presolved_matches > 0);
+  fatso_resolve_stats_reset(false);
+  struct fatso_package** list = NULL;
+  size_t size = 0;
+  fatso_dependency_graph_topological_sort(graph, &f, &list, &size, NULL);
+  ASSERT(size == 3);
+  struct fatso_package* found = find_package_in_list(list, size, "mid");
+  ASSERT(found == &mid[0]);
+  fatso_free(list);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&root);
+
+  // ...not even when a project asks for one itself:
+  struct fatso_package dead_root;
+  init_test_package(&dead_root, "root", "1.0");
+  struct fatso_dependency dep;
+  init_test_dependency(&dep, "mid", ">= 2.0");
+  fatso_push_back_v(&dead_root.base_configuration.dependencies, &dep);
+  fatso_resolve_stats_reset(true);
+  graph = fatso_dependency_graph_for_package(&f, &dead_root, &status);
+  ASSERT(status != FATSO_DEPENDENCY_GRAPH_SUCCESS);
+  ASSERT(g_fatso_stats.candidates == 0);
+  fatso_resolve_stats_reset(false);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&dead_root);
+
+  // A dependency on a package that isn't in the repository doesn't kill the
+  // version, so the resolver gets to report it:
+  struct fatso_package* lost;
+  ASSERT(fatso_repository_find_package_versions(&f, "lost", &lost) == 1);
+  ASSERT(!lost[0].is_dead);
+  struct fatso_package lost_root;
+  init_test_package(&lost_root, "root", "1.0");
+  add_test_dependency(&lost_root, "lost");
+  graph = fatso_dependency_graph_for_package(&f, &lost_root, &status);
+  ASSERT(status == FATSO_DEPENDENCY_GRAPH_UNKNOWN);
+  fatso_unknown_dependencies_t unknowns = {0};
+  fatso_dependency_graph_get_unknown_dependencies(graph, &unknowns);
+  ASSERT(unknowns.size == 1 && strcmp(unknowns.data[0]->name, "nowhere") == 0);
+  fatso_free(unknowns.data);
+  fatso_dependency_graph_free(graph);
+  fatso_package_destroy(&lost_root);
+
+  asprintf(&cmd, "rm -rf %s", home);
+  system(cmd);
+  free(cmd);
+  fatso_destroy(&f);
+}
+
 static void
 test_fatso_exec() {
   setenv("FOO", "test", 1);
@@ -255,6 +1741,28 @@ int main(int argc, char const *argv[])
   TEST(test_fatso_set_insert);
   TEST(test_fatso_multiset_insert);
   TEST(test_fatso_version_matches_constraint);
+  TEST(test_fatso_version_range);
+  TEST(test_fatso_version_columns);
+  TEST(test_fatso_intern);
+  TEST(test_fatso_repository_cursor);
+  TEST(test_fatso_dependency_graph_copy);
+  TEST(test_fatso_dependency_graph_backjumping);
+  TEST(test_fatso_dependency_graph_parallel);
+  TEST(test_fatso_dependency_graph_unsatisfiable);
+  TEST(test_fatso_dependency_graph_budget);
+  TEST(test_fatso_resolve_stats);
+  TEST(test_fatso_sort_install_levels);
+  TEST(test_fatso_lockfile);
+  TEST(test_fatso_preferred_versions);
+  TEST(test_fatso_upgrade_does_not_sync);
+  TEST(test_fatso_repository_prefetch);
+  TEST(test_fatso_resolution_cache);
+  TEST(test_fatso_parse_package_versions);
+  TEST(test_fatso_package_index);
+  TEST(test_fatso_lazy_packages);
+  TEST(test_fatso_package_cache);
+  TEST(test_fatso_shared_repository);
+  TEST(test_fatso_presolve);
   TEST(test_fatso_exec);
   return g_any_test_failed;
 }
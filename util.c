@@ -12,6 +12,7 @@
 #include <stdarg.h>
 #include <sys/param.h> // MAXPATHLEN
 #include <sys/types.h> // mkdir
+#include <time.h>      // clock_gettime
 
 #define BLACK   "\033[22;30m"
 #define RED     "\033[01;31m"
@@ -43,6 +44,13 @@ fatso_get_number_of_cpu_cores() {
   return 2;
 }
 
+double
+fatso_time_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 const char*
 fatso_get_homedir() {
   const char* homedir = getenv("HOME");
@@ -127,6 +135,16 @@ fatso_download(const char* target_path, const char* uri) {
   return r;
 }
 
+uint64_t
+fatso_hash(uint64_t h, const void* data, size_t len) {
+  const unsigned char* p = data;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
 void*
 fatso_push_back_(void** inout_data, size_t* inout_num_elements, const void* new_element, size_t element_size) {
   return fatso_append_(inout_data, inout_num_elements, new_element, element_size, 1);
@@ -144,6 +162,23 @@ fatso_append_(void** inout_data, size_t* inout_num_elements, const void* element
   return ptr;
 }
 
+int
+fatso_erase(void** inout_data, size_t* inout_num_elements, size_t idx, size_t width) {
+  size_t old_size = *inout_num_elements;
+  if (idx >= old_size) {
+    return -1;
+  }
+  byte* data = *inout_data;
+  byte* ptr = data + (idx * width);
+  memmove(ptr, ptr + width, (old_size - idx - 1) * width);
+  *inout_num_elements = old_size - 1;
+  if (*inout_num_elements == 0) {
+    fatso_free(data);
+    *inout_data = NULL;
+  }
+  return 0;
+}
+
 void*
 fatso_lower_bound(const void* key, void* base, size_t nel, size_t width, int(*compare)(const void*, const void*)) {
   int r;
@@ -3,6 +3,7 @@
 #define FATSO_UTIL_H_INCLUDED
 
 #include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
 #include <sys/types.h> // pid_t
 #include <unistd.h> // ssize_t
 #include <stdarg.h> // va_list
@@ -26,6 +27,10 @@ fatso_get_homedir();
 unsigned int
 fatso_get_number_of_cpu_cores();
 
+// Milliseconds on a monotonic clock, for timing things.
+double
+fatso_time_ms();
+
 bool
 fatso_directory_exists(const char* path);
 
@@ -41,6 +46,15 @@ fatso_run(const char* command);
 int
 fatso_download(const char* target_path, const char* uri);
 
+/*
+  64-bit FNV-1a. Pass FATSO_HASH_INIT to start, or a previous result to hash
+  several pieces of data as one.
+*/
+#define FATSO_HASH_INIT 14695981039346656037ull
+
+uint64_t
+fatso_hash(uint64_t h, const void* data, size_t len);
+
 #define FATSO_ARRAY(TYPE) struct { TYPE* data; size_t size; }
 
 struct fatso_kv_pair {
@@ -106,7 +120,7 @@ int
 fatso_erase(void** inout_data, size_t* inout_num_elements, size_t idx, size_t width);
 
 #define fatso_erase_v(array, idx) \
-  fatso_erase(&((array)->data), &((array)->size), idx, sizeof(*((array)->data)))
+  fatso_erase((void**)&((array)->data), &((array)->size), idx, sizeof(*((array)->data)))
 
 void*
 fatso_multiset_insert(void** inout_data, size_t* inout_num_elements, const void* new_element, size_t width, int(*compare)(const void*, const void*));
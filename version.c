@@ -2,8 +2,8 @@
 #include "util.h"
 
 #include <string.h>
-#include <ctype.h>  // isalpha, isspace
-#include <stdlib.h> // atoi
+#include <ctype.h>  // isspace
+#include <stdlib.h> // free
 
 const char*
 fatso_version_requirement_to_string(enum fatso_version_requirement req) {
@@ -19,6 +19,21 @@ fatso_version_requirement_to_string(enum fatso_version_requirement req) {
   }
 }
 
+/*
+  A version is split into components at every switch between digits and
+  letters, and at every other character, so "1.2rc3" is 1, 2, "rc", 3. Each
+  component is packed into a key when the version is parsed, so that comparing
+  two versions is a loop over integers:
+
+    - Numbers are their own key, so they order by value.
+    - Letters have VERSION_KEY_ALPHA set, which puts them after every number,
+      and their first 7 characters packed big-endian below it, so they order
+      like strcmp. Only components longer than that need to look at `string`
+      when the keys are equal.
+*/
+#define VERSION_KEY_ALPHA (1ull << 63)
+#define VERSION_KEY_ALPHA_CHARS 7
+
 void
 fatso_version_init(struct fatso_version* ver) {
   memset(ver, 0, sizeof(*ver));
@@ -28,27 +43,56 @@ void
 fatso_version_copy(struct fatso_version* a, const struct fatso_version* b) {
   fatso_version_destroy(a);
   a->string = b->string ? strdup(b->string) : NULL;
-  for (size_t i = 0; i < b->components.size; ++i) {
-    fatso_version_append_component(a, b->components.data[i], strlen(b->components.data[i]));
-  }
+  a->components = b->components;
 }
 
 void
 fatso_version_destroy(struct fatso_version* ver) {
-  for (size_t i = 0; i < ver->components.size; ++i) {
-    fatso_free(ver->components.data[i]);
-  }
-  fatso_free(ver->components.data);
-  ver->components.data = NULL;
   ver->components.size = 0;
   fatso_free(ver->string);
 }
 
-void
-fatso_version_append_component(struct fatso_version* ver, const char* component, size_t n) {
-  if (n == 0) return;
-  char* append = strndup(component, n);
-  fatso_push_back_v(&ver->components, &append);
+static bool
+is_digit(int c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool
+is_alpha(int c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static void
+append_component(struct fatso_version* ver, const char* str, size_t offset, size_t n) {
+  if (n == 0)
+    return;
+  if (ver->components.size == FATSO_VERSION_MAX_COMPONENTS) {
+    ver->components.truncated = true;
+    return;
+  }
+  const char* component = str + offset;
+  uint64_t key = 0;
+  if (is_alpha(*component)) {
+    for (size_t i = 0; i < VERSION_KEY_ALPHA_CHARS; ++i) {
+      key = (key << 8) | (i < n ? (unsigned char)component[i] : 0);
+    }
+    key |= VERSION_KEY_ALPHA;
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      key = key * 10 + (component[i] - '0');
+      if (key >= VERSION_KEY_ALPHA / 10) {
+        // Absurdly large numbers all compare equal.
+        key = VERSION_KEY_ALPHA - 1;
+        break;
+      }
+    }
+  }
+  struct fatso_version_component c = {
+    .key = key,
+    .offset = (uint32_t)offset,
+    .length = (uint32_t)n,
+  };
+  ver->components.data[ver->components.size++] = c;
 }
 
 int
@@ -58,30 +102,30 @@ fatso_version_from_string(struct fatso_version* ver, const char* str) {
     ALPHA,
     NUMERIC,
   } state = INITIAL;
-  ver->components.data = NULL;
   ver->components.size = 0;
+  ver->components.truncated = false;
   const char* component_start = str;
   const char* p = str;
 
   for (; *p; ++p) {
     int c = *p;
-    if (c >= '0' && c <= '9') {
+    if (is_digit(c)) {
       switch (state) {
         case INITIAL: state = NUMERIC; break;
         case NUMERIC: break;
         case ALPHA: {
-          fatso_version_append_component(ver, component_start, p - component_start);
+          append_component(ver, str, component_start - str, p - component_start);
           component_start = p;
           state = NUMERIC;
           break;
         }
       }
-    } else if (isalpha(c)) {
+    } else if (is_alpha(c)) {
       switch (state) {
         case INITIAL: state = ALPHA; break;
         case ALPHA: break;
         case NUMERIC: {
-          fatso_version_append_component(ver, component_start, p - component_start);
+          append_component(ver, str, component_start - str, p - component_start);
           component_start = p;
           state = ALPHA;
           break;
@@ -90,18 +134,28 @@ fatso_version_from_string(struct fatso_version* ver, const char* str) {
     } else {
       // Non-alphanumeric means breaking a component.
       if (component_start != p) {
-        fatso_version_append_component(ver, component_start, p - component_start);
+        append_component(ver, str, component_start - str, p - component_start);
       }
       component_start = p+1;
     }
   }
   // Append trailing:
-  fatso_version_append_component(ver, component_start, p - component_start);
+  append_component(ver, str, component_start - str, p - component_start);
 
   ver->string = strdup(str);
   return 0;
 }
 
+// Letters that don't fit in the key are compared the slow way.
+static int
+compare_long_alpha(const struct fatso_version* a, const struct fatso_version_component* ac, const struct fatso_version* b, const struct fatso_version_component* bc) {
+  size_t n = ac->length < bc->length ? ac->length : bc->length;
+  int r = memcmp(a->string + ac->offset, b->string + bc->offset, n);
+  if (r != 0)
+    return r;
+  return ac->length == bc->length ? 0 : (ac->length < bc->length ? -1 : 1);
+}
+
 int
 fatso_version_compare_n_components(const struct fatso_version* a, const struct fatso_version* b, size_t n) {
   if (a->components.size < n)
@@ -109,30 +163,15 @@ fatso_version_compare_n_components(const struct fatso_version* a, const struct f
   if (b->components.size < n)
     n = b->components.size;
 
-  int r;
-
   for (size_t i = 0; i < n; ++i) {
-    const char* ac = a->components.data[i];
-    const char* bc = b->components.data[i];
-    if (isalpha(*ac) && isalpha(*bc)) {
-      // Both are alphanumeric, use strcmp:
-      r = strcmp(ac, bc);
+    const struct fatso_version_component* ac = &a->components.data[i];
+    const struct fatso_version_component* bc = &b->components.data[i];
+    if (ac->key != bc->key)
+      return ac->key < bc->key ? -1 : 1;
+    if ((ac->key & VERSION_KEY_ALPHA) && (ac->length > VERSION_KEY_ALPHA_CHARS || bc->length > VERSION_KEY_ALPHA_CHARS)) {
+      int r = compare_long_alpha(a, ac, b, bc);
       if (r != 0)
         return r;
-    } else {
-      // One isn't alphanumeric -- put that one first:
-      if (isalpha(*ac)) {
-        return 1;
-      } else if (isalpha(*bc)) {
-        return -1;
-      } else {
-        // Both are numeric, compare numbers:
-        int ai = atoi(ac);
-        int bi = atoi(bc);
-        r = ai - bi;
-        if (r != 0)
-          return r;
-      }
     }
   }
 
@@ -140,10 +179,29 @@ fatso_version_compare_n_components(const struct fatso_version* a, const struct f
   return 0;
 }
 
+// Compares what comes after the components that were kept, the slow way.
+static int
+compare_truncated(const struct fatso_version* a, const struct fatso_version* b) {
+  const struct fatso_version_component* al = &a->components.data[FATSO_VERSION_MAX_COMPONENTS - 1];
+  const struct fatso_version_component* bl = &b->components.data[FATSO_VERSION_MAX_COMPONENTS - 1];
+  struct fatso_version at, bt;
+  fatso_version_init(&at);
+  fatso_version_init(&bt);
+  fatso_version_from_string(&at, a->string + al->offset + al->length);
+  fatso_version_from_string(&bt, b->string + bl->offset + bl->length);
+  int r = fatso_version_compare(&at, &bt);
+  fatso_version_destroy(&at);
+  fatso_version_destroy(&bt);
+  return r;
+}
+
 int
 fatso_version_compare(const struct fatso_version* a, const struct fatso_version* b) {
   size_t n = a->components.size < b->components.size ? a->components.size : b->components.size;
   int r = fatso_version_compare_n_components(a, b, n);
+  if (r == 0 && (a->components.truncated || b->components.truncated) && a->components.size == b->components.size) {
+    return compare_truncated(a, b);
+  }
   if (r == 0) {
     // Everything else was equal, so compare the number of components, where the
     // shortest comes first:
@@ -164,12 +222,13 @@ fatso_version_string(const struct fatso_version* ver) {
 
 bool
 fatso_version_matches_constraints(const struct fatso_version* version, const struct fatso_constraint* constraints, size_t num_constraints) {
+  FATSO_STAT_ADD(constraint_evaluations, 1);
   for (size_t i = 0; i < num_constraints; ++i) {
     const struct fatso_constraint* c = &constraints[i];
     int cmp = fatso_version_compare(version, &c->version);
     switch (c->version_requirement) {
       case FATSO_VERSION_ANY: {
-        return true;
+        break;
       }
       case FATSO_VERSION_LT: {
         if (!(cmp < 0)) return false;
@@ -206,6 +265,297 @@ fatso_version_matches_constraints(const struct fatso_version* version, const str
   return true;
 }
 
+/*
+  A version range is the intersection of any number of constraints, kept as a
+  lower and an upper bound, so matching a version costs two comparisons no
+  matter how many constraints went into it. `~> 1.2.3` covers every version
+  starting with 1.2, which is the range from 1.2 up to just after the last
+  version starting with 1.2 -- that's what FATSO_BOUND_PREFIX means.
+*/
+
+void
+fatso_version_range_init(struct fatso_version_range* range) {
+  memset(range, 0, sizeof(*range));
+}
+
+void
+fatso_version_range_copy(struct fatso_version_range* dst, const struct fatso_version_range* src) {
+  fatso_version_copy(&dst->lower.version, &src->lower.version);
+  dst->lower.type = src->lower.type;
+  fatso_version_copy(&dst->upper.version, &src->upper.version);
+  dst->upper.type = src->upper.type;
+  dst->empty = src->empty;
+}
+
+void
+fatso_version_range_destroy(struct fatso_version_range* range) {
+  fatso_version_destroy(&range->lower.version);
+  fatso_version_destroy(&range->upper.version);
+  fatso_version_range_init(range);
+}
+
+static bool
+version_has_prefix(const struct fatso_version* version, const struct fatso_version* prefix) {
+  size_t n = prefix->components.size;
+  return version->components.size >= n && fatso_version_compare_n_components(version, prefix, n) == 0;
+}
+
+static void
+version_prefix(struct fatso_version* dst, const struct fatso_version* src, size_t n) {
+  fatso_strbuf_t buf;
+  fatso_strbuf_init(&buf);
+  fatso_version_destroy(dst);
+  for (size_t i = 0; i < n; ++i) {
+    const struct fatso_version_component* c = &src->components.data[i];
+    if (i) {
+      fatso_strbuf_append(&buf, ".", 1);
+    }
+    fatso_strbuf_append(&buf, src->string + c->offset, c->length);
+  }
+  char* string = fatso_strbuf_strdup(&buf);
+  fatso_version_from_string(dst, string);
+  fatso_free(string);
+  fatso_strbuf_destroy(&buf);
+}
+
+// Orders lower bounds by how much they exclude.
+static int
+compare_lower_bounds(const struct fatso_version_bound* a, const struct fatso_version_bound* b) {
+  if (a->type == FATSO_BOUND_NONE || b->type == FATSO_BOUND_NONE)
+    return (a->type != FATSO_BOUND_NONE) - (b->type != FATSO_BOUND_NONE);
+  int r = fatso_version_compare(&a->version, &b->version);
+  if (r != 0)
+    return r;
+  return (a->type == FATSO_BOUND_EXCLUSIVE) - (b->type == FATSO_BOUND_EXCLUSIVE);
+}
+
+// Orders upper bounds by how much they include.
+static int
+compare_upper_bounds(const struct fatso_version_bound* a, const struct fatso_version_bound* b) {
+  if (a->type == FATSO_BOUND_NONE || b->type == FATSO_BOUND_NONE)
+    return (a->type == FATSO_BOUND_NONE) - (b->type == FATSO_BOUND_NONE);
+  // A prefix bound lies past every version starting with the prefix.
+  bool a_covers_b = a->type == FATSO_BOUND_PREFIX && version_has_prefix(&b->version, &a->version);
+  bool b_covers_a = b->type == FATSO_BOUND_PREFIX && version_has_prefix(&a->version, &b->version);
+  if (a_covers_b || b_covers_a)
+    return (int)a_covers_b - (int)b_covers_a;
+  int r = fatso_version_compare(&a->version, &b->version);
+  if (r != 0)
+    return r;
+  static const int rank[] = {
+    [FATSO_BOUND_EXCLUSIVE] = 0,
+    [FATSO_BOUND_INCLUSIVE] = 1,
+    [FATSO_BOUND_PREFIX] = 2,
+  };
+  return rank[a->type] - rank[b->type];
+}
+
+static bool
+above_lower_bound(const struct fatso_version* version, const struct fatso_version_bound* bound) {
+  switch (bound->type) {
+    case FATSO_BOUND_INCLUSIVE: return fatso_version_compare(version, &bound->version) >= 0;
+    case FATSO_BOUND_EXCLUSIVE: return fatso_version_compare(version, &bound->version) > 0;
+    default: return true;
+  }
+}
+
+static bool
+below_upper_bound(const struct fatso_version* version, const struct fatso_version_bound* bound) {
+  switch (bound->type) {
+    case FATSO_BOUND_INCLUSIVE: return fatso_version_compare(version, &bound->version) <= 0;
+    case FATSO_BOUND_EXCLUSIVE: return fatso_version_compare(version, &bound->version) < 0;
+    case FATSO_BOUND_PREFIX: return fatso_version_compare_n_components(version, &bound->version, bound->version.components.size) <= 0;
+    default: return true;
+  }
+}
+
+static void
+tighten_bound(struct fatso_version_bound* bound, const struct fatso_version_bound* other, int(*compare)(const struct fatso_version_bound*, const struct fatso_version_bound*), int sign) {
+  if (compare(other, bound) * sign > 0) {
+    fatso_version_copy(&bound->version, &other->version);
+    bound->type = other->type;
+  }
+}
+
+static bool
+range_is_empty(const struct fatso_version_range* range) {
+  const struct fatso_version_bound* lower = &range->lower;
+  const struct fatso_version_bound* upper = &range->upper;
+  if (lower->type == FATSO_BOUND_NONE || upper->type == FATSO_BOUND_NONE)
+    return false;
+  if (upper->type == FATSO_BOUND_PREFIX) {
+    if (version_has_prefix(&lower->version, &upper->version))
+      return false;
+    return fatso_version_compare(&lower->version, &upper->version) > 0;
+  }
+  int r = fatso_version_compare(&lower->version, &upper->version);
+  if (r != 0)
+    return r > 0;
+  return lower->type != FATSO_BOUND_INCLUSIVE || upper->type != FATSO_BOUND_INCLUSIVE;
+}
+
+bool
+fatso_version_range_intersect(struct fatso_version_range* range, const struct fatso_constraint* c) {
+  // The bounds borrow the constraint's version, or its prefix for `~>`.
+  struct fatso_version prefix = {0};
+  const struct fatso_version* v = &c->version;
+  enum fatso_version_bound_type lower = FATSO_BOUND_NONE;
+  enum fatso_version_bound_type upper = FATSO_BOUND_NONE;
+
+  switch (c->version_requirement) {
+    case FATSO_VERSION_ANY: break;
+    case FATSO_VERSION_LT: upper = FATSO_BOUND_EXCLUSIVE; break;
+    case FATSO_VERSION_LE: upper = FATSO_BOUND_INCLUSIVE; break;
+    case FATSO_VERSION_EQ: lower = upper = FATSO_BOUND_INCLUSIVE; break;
+    case FATSO_VERSION_GT: lower = FATSO_BOUND_EXCLUSIVE; break;
+    case FATSO_VERSION_GE: lower = FATSO_BOUND_INCLUSIVE; break;
+    case FATSO_VERSION_APPROXIMATELY: {
+      size_t n = c->version.components.size;
+      if (n > 1) {
+        version_prefix(&prefix, &c->version, n - 1);
+        v = &prefix;
+        lower = FATSO_BOUND_INCLUSIVE;
+        upper = FATSO_BOUND_PREFIX;
+      }
+      break;
+    }
+  }
+
+  if (lower != FATSO_BOUND_NONE) {
+    struct fatso_version_bound bound = { .version = *v, .type = lower };
+    tighten_bound(&range->lower, &bound, compare_lower_bounds, 1);
+  }
+  if (upper != FATSO_BOUND_NONE) {
+    struct fatso_version_bound bound = { .version = *v, .type = upper };
+    tighten_bound(&range->upper, &bound, compare_upper_bounds, -1);
+  }
+  fatso_version_destroy(&prefix);
+
+  range->empty = range->empty || range_is_empty(range);
+  return !range->empty;
+}
+
+bool
+fatso_version_range_contains(const struct fatso_version_range* range, const struct fatso_version* version) {
+  FATSO_STAT_ADD(constraint_evaluations, 1);
+  return !range->empty && above_lower_bound(version, &range->lower) && below_upper_bound(version, &range->upper);
+}
+
+int
+fatso_version_range_compare(const struct fatso_version_range* range, const struct fatso_version* version) {
+  FATSO_STAT_ADD(constraint_evaluations, 1);
+  if (range->empty || !above_lower_bound(version, &range->lower))
+    return -1;
+  return below_upper_bound(version, &range->upper) ? 0 : 1;
+}
+
+static bool
+keys_suffice(const struct fatso_version* version) {
+  if (version->components.truncated)
+    return false;
+  for (size_t i = 0; i < version->components.size; ++i) {
+    const struct fatso_version_component* c = &version->components.data[i];
+    if ((c->key & VERSION_KEY_ALPHA) && c->length > VERSION_KEY_ALPHA_CHARS)
+      return false;
+  }
+  return true;
+}
+
+void
+fatso_version_columns_init(struct fatso_version_columns* columns, const struct fatso_version* const* versions, size_t num_versions) {
+  memset(columns, 0, sizeof(*columns));
+  columns->size = num_versions;
+  columns->keys_suffice = true;
+  for (size_t i = 0; i < num_versions; ++i) {
+    if (versions[i]->components.size > columns->num_components) {
+      columns->num_components = versions[i]->components.size;
+    }
+    columns->keys_suffice = columns->keys_suffice && keys_suffice(versions[i]);
+  }
+
+  columns->keys = fatso_calloc(columns->num_components * num_versions + 1, sizeof(uint64_t));
+  columns->sizes = fatso_calloc(num_versions + 1, sizeof(uint8_t));
+  for (size_t i = 0; i < num_versions; ++i) {
+    columns->sizes[i] = versions[i]->components.size;
+    for (size_t c = 0; c < versions[i]->components.size; ++c) {
+      columns->keys[c * num_versions + i] = versions[i]->components.data[c].key;
+    }
+  }
+}
+
+void
+fatso_version_columns_destroy(struct fatso_version_columns* columns) {
+  fatso_free(columns->keys);
+  fatso_free(columns->sizes);
+  memset(columns, 0, sizeof(*columns));
+}
+
+// Compares versions [begin, begin + n) of `columns` to `v` like
+// fatso_version_compare does, or like fatso_version_compare_n_components with
+// all of v's components if `prefix` is set. Written so the inner loop has no
+// branches, which lets the compiler vectorize it.
+static void
+compare_columns(const struct fatso_version_columns* columns, size_t begin, size_t n, const struct fatso_version* v, bool prefix, int8_t* out) {
+  const uint8_t* sizes = &columns->sizes[begin];
+  const int8_t ended = prefix ? 0 : -1; // for versions that are shorter than v
+  memset(out, 0, n);
+
+  size_t num_components = v->components.size < columns->num_components ? v->components.size : columns->num_components;
+  for (size_t c = 0; c < num_components; ++c) {
+    uint64_t key = v->components.data[c].key;
+    const uint64_t* keys = &columns->keys[c * columns->size + begin];
+    for (size_t i = 0; i < n; ++i) {
+      int8_t cmp = (keys[i] > key) - (keys[i] < key);
+      int8_t r = c < sizes[i] ? cmp : ended;
+      out[i] = out[i] ? out[i] : r;
+    }
+  }
+
+  // What's still undecided is equal as far as the shorter version goes.
+  for (size_t i = 0; i < n; ++i) {
+    int8_t r = prefix ? 0 : (sizes[i] > v->components.size) - (sizes[i] < v->components.size);
+    out[i] = out[i] ? out[i] : r;
+  }
+}
+
+static uint64_t
+mask_from_comparisons(const int8_t* cmp, size_t n, int8_t min, int8_t max) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < n; ++i) {
+    mask |= (uint64_t)(cmp[i] >= min && cmp[i] <= max) << i;
+  }
+  return mask;
+}
+
+bool
+fatso_version_range_match_columns(const struct fatso_version_range* range, const struct fatso_version_columns* columns, uint64_t* out_words) {
+  const struct fatso_version_bound* lower = &range->lower;
+  const struct fatso_version_bound* upper = &range->upper;
+  if (!columns->keys_suffice)
+    return false;
+  if (lower->type != FATSO_BOUND_NONE && !keys_suffice(&lower->version))
+    return false;
+  if (upper->type != FATSO_BOUND_NONE && !keys_suffice(&upper->version))
+    return false;
+
+  FATSO_STAT_ADD(constraint_evaluations, columns->size);
+  int8_t cmp[64];
+  for (size_t begin = 0; begin < columns->size; begin += 64) {
+    size_t n = columns->size - begin < 64 ? columns->size - begin : 64;
+    uint64_t mask = range->empty ? 0 : (n == 64 ? ~0ull : (1ull << n) - 1);
+    if (mask && lower->type != FATSO_BOUND_NONE) {
+      compare_columns(columns, begin, n, &lower->version, false, cmp);
+      mask &= mask_from_comparisons(cmp, n, lower->type == FATSO_BOUND_INCLUSIVE ? 0 : 1, 1);
+    }
+    if (mask && upper->type != FATSO_BOUND_NONE) {
+      compare_columns(columns, begin, n, &upper->version, upper->type == FATSO_BOUND_PREFIX, cmp);
+      mask &= mask_from_comparisons(cmp, n, -1, upper->type == FATSO_BOUND_EXCLUSIVE ? -1 : 0);
+    }
+    out_words[begin / 64] = mask;
+  }
+  return true;
+}
+
 void
 fatso_constraint_destroy(struct fatso_constraint* c) {
   fatso_version_destroy(&c->version);
@@ -266,9 +616,10 @@ fatso_constraint_to_string(const struct fatso_constraint* c) {
   return buffer;
 }
 
+// The string stays valid until the next call on the same thread.
 const char*
 fatso_constraint_to_string_unsafe(const struct fatso_constraint* c) {
-  static char* p = NULL;
+  static __thread char* p = NULL;
   free(p);
   const char* modifier = fatso_version_requirement_to_string(c->version_requirement);
   asprintf(&p, "%s%s%s", modifier, c->version_requirement != FATSO_VERSION_ANY ? " " : "", c->version_requirement != FATSO_VERSION_ANY ? fatso_version_string(&c->version) : "");